@@ -0,0 +1,37 @@
+#include "Allocations.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Kept in a translation unit of their own: the compiler must not see a malloc inlined into one call
+// and a free into another and take them for a mismatched pair
+static atomic<bool> counting = false;
+static atomic<size_t> count = 0;
+
+void* operator new(size_t size) {
+	if (counting) count++;
+	if (void* memory = malloc(size ? size : 1)) return memory;
+	throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+namespace Allocations {
+	void Start() {
+		count = 0;
+		counting = true;
+	}
+
+	size_t Stop() {
+		counting = false;
+		return count;
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+
+// The global operator new is replaced in Allocations.cpp so that heap allocations can be counted,
+// TestAllocationFree checks with it that the fixed compile makes none
+namespace Allocations {
+	// Starts counting from zero
+	void Start();
+	// Stops counting and returns the allocations made since Start
+	size_t Stop();
+}
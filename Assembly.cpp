@@ -0,0 +1,191 @@
+#include "Assembly.h"
+#include <algorithm>
+#include <set>
+
+using namespace std;
+
+namespace Parse {
+	ostream& operator<< (ostream& os, const Operand& operand) {
+		switch (operand.kind) {
+		case Operand::Kind::Register:
+			return os << operand.name;
+		case Operand::Kind::Immediate:
+			return os << operand.value;
+		case Operand::Kind::Frame:
+			return os << operand.size << "[rbp - " << operand.value << "]";
+		case Operand::Kind::Symbol:
+			if (!operand.size.empty()) os << operand.size << "[";
+			os << operand.name;
+			if (operand.value != Operand::none) os << operand.value;
+			if (!operand.size.empty()) os << "]";
+			return os;
+		default:
+			return os;
+		}
+	}
+
+	ostream& operator<< (ostream& os, const Instruction& instruction) {
+		switch (instruction.op) {
+		case Instruction::Op::Comment:
+			return os << "; " << instruction.comment[0] << instruction.comment[1] << instruction.comment[2];
+		case Instruction::Op::Label:
+			return os << instruction.dst << ":";
+		case Instruction::Op::Push:
+			return os << "push " << instruction.dst;
+		case Instruction::Op::Pop:
+			return os << "pop " << instruction.dst;
+		case Instruction::Op::Mov:
+			return os << "mov " << instruction.dst << ", " << instruction.src;
+		case Instruction::Op::Lea:
+			return os << "lea " << instruction.dst << ", " << instruction.src;
+		case Instruction::Op::Xor:
+			return os << "xor " << instruction.dst << ", " << instruction.src;
+		case Instruction::Op::In:
+			return os << "in " << instruction.dst << ", " << instruction.src;
+		case Instruction::Op::Jmp:
+			return os << "jmp " << instruction.dst;
+		case Instruction::Op::Ret:
+			return os << "ret";
+		case Instruction::Op::RepMovsq:
+			return os << "rep movsq";
+		case Instruction::Op::Movups:
+			return os << "movups " << instruction.dst << ", " << instruction.src;
+		case Instruction::Op::Dq:
+			return os << "dq " << instruction.dst;
+		default:
+			return os;
+		}
+	}
+
+	static bool IsImmediateStore(const Instruction& instruction) {
+		return instruction.op == Instruction::Op::Mov && instruction.dst.kind == Operand::Kind::Frame
+			&& instruction.src.kind == Operand::Kind::Immediate;
+	}
+
+	static bool FitsImmediate32(uint64_t value) {
+		return value <= INT32_MAX || value >= static_cast<uint64_t>(INT32_MIN);
+	}
+
+	// A store of a wide immediate is counted as the two instructions it is assembled to
+	size_t CountInstructions(const pmr::vector<Instruction>& code) {
+		size_t count = 0;
+		for (const auto& instruction : code)
+			if (instruction.IsCode()) count += (IsImmediateStore(instruction) && !FitsImmediate32(instruction.src.value)) ? 2 : 1;
+		return count;
+	}
+
+	// Index of the next instruction that is not a comment
+	static size_t Next(const pmr::vector<Instruction>& code, size_t i) {
+		while (++i < code.size() && code[i].op == Instruction::Op::Comment);
+		return i;
+	}
+
+	static bool SameSymbol(const Operand& lhs, const Operand& rhs) {
+		return lhs.kind == Operand::Kind::Symbol && rhs.kind == Operand::Kind::Symbol
+			&& lhs.name == rhs.name && lhs.value == rhs.value;
+	}
+
+	// Two stores of immediates that fit 32 bits are two instructions, as many as the merged store: only
+	// a pair with a wide immediate, which would need a mov through rax, is merged
+	static void MergeStores(pmr::vector<Instruction>& code, pmr::vector<Literal>& literals) {
+		pmr::vector<Instruction> merged(code.get_allocator());
+		merged.reserve(code.size());
+		for (size_t i = 0; i < code.size(); ++i) {
+			size_t j = Next(code, i);
+			if (!IsImmediateStore(code[i]) || j == code.size() || !IsImmediateStore(code[j])
+				|| max(code[i].dst.value, code[j].dst.value) - min(code[i].dst.value, code[j].dst.value) != 8
+				|| (FitsImmediate32(code[i].src.value) && FitsImmediate32(code[j].src.value))) {
+				merged.push_back(move(code[i]));
+				continue;
+			}
+			// The comments between the stores stay before the merged store
+			for (size_t k = i + 1; k < j; ++k)
+				merged.push_back(move(code[k]));
+			const auto& low = code[i].dst.value > code[j].dst.value ? code[i] : code[j];
+			const auto& high = code[i].dst.value > code[j].dst.value ? code[j] : code[i];
+			auto xmm0 = Operand::Register("xmm0");
+			merged.push_back({ Instruction::Op::Movups, xmm0, Operand::Symbol("literal", literals.size(), "XMMWORD PTR") });
+			merged.push_back({ Instruction::Op::Movups, Operand::Frame(low.dst.value, "XMMWORD PTR"), xmm0 });
+			literals.push_back({ low.src.value, high.src.value });
+			i = j;
+		}
+		code = move(merged);
+	}
+
+	static void LowerWideStores(pmr::vector<Instruction>& code) {
+		pmr::vector<Instruction> lowered(code.get_allocator());
+		lowered.reserve(code.size());
+		for (auto& instruction : code) {
+			if (IsImmediateStore(instruction) && !FitsImmediate32(instruction.src.value)) {
+				auto rax = Operand::Register("rax");
+				lowered.push_back({ Instruction::Op::Mov, rax, instruction.src });
+				instruction.src = rax;
+			}
+			lowered.push_back(move(instruction));
+		}
+		code = move(lowered);
+	}
+
+	static void RemoveJumps(pmr::vector<Instruction>& code) {
+		pmr::vector<bool> removed(code.size(), code.get_allocator());
+		for (size_t i = 0; i < code.size(); ++i) {
+			if (code[i].op != Instruction::Op::Jmp) continue;
+			// Jumps over nothing but comments and other labels
+			for (size_t j = Next(code, i); j < code.size() && code[j].op == Instruction::Op::Label; j = Next(code, j))
+				if (SameSymbol(code[j].dst, code[i].dst)) removed[i] = true;
+		}
+		pmr::set<pair<string_view, uint64_t>> targets(code.get_allocator());
+		for (size_t i = 0; i < code.size(); ++i)
+			if (code[i].op == Instruction::Op::Jmp && !removed[i])
+				targets.emplace(code[i].dst.name, code[i].dst.value);
+		for (size_t i = 0; i < code.size(); ++i)
+			if (code[i].op == Instruction::Op::Label && !targets.count({ code[i].dst.name, code[i].dst.value }))
+				removed[i] = true;
+
+		size_t kept = 0;
+		for (size_t i = 0; i < code.size(); ++i)
+			if (!removed[i]) {
+				if (kept != i) code[kept] = move(code[i]);
+				kept++;
+			}
+		code.resize(kept);
+	}
+
+	// Code between an unconditional transfer and the next label is never executed
+	static void RemoveUnreachable(pmr::vector<Instruction>& code) {
+		bool reachable = true;
+		code.erase(remove_if(code.begin(), code.end(), [&reachable](const Instruction& instruction) {
+			if (instruction.op == Instruction::Op::Label) reachable = true;
+			if (!instruction.IsCode()) return false;
+			bool removed = !reachable;
+			if (instruction.op == Instruction::Op::Jmp || instruction.op == Instruction::Op::Ret) reachable = false;
+			return removed;
+		}), code.end());
+	}
+
+	static bool IsFrame(const Instruction& instruction) {
+		return ((instruction.op == Instruction::Op::Push || instruction.op == Instruction::Op::Pop)
+			&& instruction.dst.IsRegister("rbp"))
+			|| (instruction.op == Instruction::Op::Mov && instruction.dst.IsRegister("rbp") && instruction.src.IsRegister("rsp"));
+	}
+
+	static bool UsesFrame(const Instruction& instruction) {
+		for (const auto* operand : { &instruction.dst, &instruction.src })
+			if (operand->kind == Operand::Kind::Frame || operand->IsRegister("rbp")) return true;
+		return false;
+	}
+
+	static void RemoveFrame(pmr::vector<Instruction>& code) {
+		for (const auto& instruction : code)
+			if (!IsFrame(instruction) && UsesFrame(instruction)) return;
+		code.erase(remove_if(code.begin(), code.end(), IsFrame), code.end());
+	}
+
+	void Peephole(pmr::vector<Instruction>& code, pmr::vector<Literal>& literals) {
+		MergeStores(code, literals);
+		LowerWideStores(code);
+		RemoveUnreachable(code);
+		RemoveJumps(code);
+		RemoveFrame(code);
+	}
+}
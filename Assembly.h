@@ -0,0 +1,68 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <array>
+#include <cstdint>
+
+namespace Parse {
+	// Operand of the generated code: names are views to literals or to the symbol table
+	struct Operand {
+		enum class Kind { None, Register, Immediate, Frame, Symbol };
+
+		static constexpr uint64_t none = UINT64_MAX;
+
+		Kind kind = Kind::None;
+		std::string_view name{}; // Register or symbol, a numbered symbol is the name followed by the value
+		uint64_t value = none; // Immediate, displacement below rbp of the frame operand or number of the symbol
+		std::string_view size{}; // Memory operands: "QWORD PTR", "XMMWORD PTR" or none for lea
+
+		static Operand Register(std::string_view name) { return { Kind::Register, name }; }
+		static Operand Immediate(uint64_t value) { return { Kind::Immediate, {}, value }; }
+		static Operand Frame(uint64_t displacement, std::string_view size = "QWORD PTR") {
+			return { Kind::Frame, {}, displacement, size };
+		}
+		static Operand Symbol(std::string_view name, uint64_t number = none, std::string_view size = {}) {
+			return { Kind::Symbol, name, number, size };
+		}
+
+		bool IsRegister(std::string_view reg) const { return kind == Kind::Register && name == reg; }
+	};
+
+	struct Instruction {
+		enum class Op { Comment, Label, Push, Pop, Mov, Lea, Xor, In, Jmp, Ret, RepMovsq, Movups, Dq };
+
+		Op op;
+		Operand dst{}; // The value of dq
+		Operand src{};
+		std::array<std::string_view, 3> comment{}; // Printed one after another, views to literals or names
+
+		static Instruction Note(std::string_view first, std::string_view second = {}, std::string_view third = {}) {
+			return { Op::Comment, {}, {}, { first, second, third } };
+		}
+		bool IsCode() const { return op != Op::Comment && op != Op::Label && op != Op::Dq; }
+	};
+
+	std::ostream& operator<< (std::ostream& os, const Operand& operand);
+	std::ostream& operator<< (std::ostream& os, const Instruction& instruction);
+
+	// 16 bytes of .rodata loaded by a merged store, low qword first
+	struct Literal {
+		uint64_t low;
+		uint64_t high;
+	};
+
+	size_t CountInstructions(const std::pmr::vector<Instruction>& code);
+
+	// Rewrites the code in place:
+	// - two stores of immediates to adjacent qwords, one of them wider than 32 bits, become one 16 byte store
+	//   from a literal,
+	// - stores of immediates that do not fit the sign extended 32 bits go through rax,
+	// - code that follows a jump or ret up to the next label, jumps to the next instruction
+	//   and labels without jumps are removed,
+	// - the frame is dropped if nothing but the prologue and the epilogue uses rbp.
+	// The work lists are allocated from the memory of the code.
+	void Peephole(std::pmr::vector<Instruction>& code, std::pmr::vector<Literal>& literals);
+}
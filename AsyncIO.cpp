@@ -0,0 +1,115 @@
+#include "AsyncIO.h"
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include "Trace.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAS_MMAP
+#endif
+
+using namespace std;
+
+IoPool::IoPool(size_t threads) {
+	for (size_t i = 0; i < threads; ++i)
+		workers.emplace_back([this] { Work(); });
+}
+
+IoPool::~IoPool() {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+	}
+	has_jobs.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void IoPool::Push(function<void()> job) {
+	{
+		lock_guard<std::mutex> lock(mutex);
+		jobs.push(move(job));
+	}
+	has_jobs.notify_one();
+}
+
+void IoPool::Work() {
+	while (true) {
+		function<void()> job;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			has_jobs.wait(lock, [this] { return stopped || !jobs.empty(); });
+			if (jobs.empty()) return; // Stopped and every queued job is done
+			job = move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
+
+future<optional<string>> IoPool::Read(string path) {
+	auto task = make_shared<packaged_task<optional<string>()>>([path = move(path)]() -> optional<string> {
+		TRACE_SPAN("read", path);
+		ifstream input(path);
+		if (!input.is_open()) return {};
+		stringstream content;
+		content << input.rdbuf();
+		return content.str();
+	});
+	auto result = task->get_future();
+	Push([task] { (*task)(); });
+	return result;
+}
+
+future<bool> IoPool::Write(string path, string content) {
+	auto task = make_shared<packaged_task<bool()>>([path = move(path), content = move(content)] {
+		TRACE_SPAN("write", path);
+		ofstream output(path);
+		if (!output.is_open()) return false;
+		output.write(content.data(), content.size());
+		return static_cast<bool>(output);
+	});
+	auto result = task->get_future();
+	Push([task] { (*task)(); });
+	return result;
+}
+
+MappedFile::MappedFile(const string& path) {
+#ifdef HAS_MMAP
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat info;
+	if (fstat(fd, &info) == 0) {
+		is_open = true;
+		size = static_cast<size_t>(info.st_size);
+		if (size) {
+			void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED) {
+				data = static_cast<const char*>(view);
+				mapped = true;
+			}
+		}
+	}
+	close(fd);
+	if (mapped || !is_open || !size) return;
+	is_open = false;
+#endif
+	ifstream input(path, ios::binary);
+	if (!input.is_open()) return;
+	stringstream content;
+	content << input.rdbuf();
+	buffer = content.str();
+	data = buffer.data();
+	size = buffer.size();
+	is_open = true;
+}
+
+MappedFile::~MappedFile() {
+#ifdef HAS_MMAP
+	if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+}
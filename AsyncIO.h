@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <optional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// Pool of threads that read and write whole files, so that the batch runner
+// can prefetch the next inputs and flush outputs while compiling
+class IoPool {
+public:
+	explicit IoPool(size_t threads = 2);
+	~IoPool();
+
+	std::future<std::optional<std::string>> Read(std::string path);
+	std::future<bool> Write(std::string path, std::string content);
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable has_jobs;
+	bool stopped = false;
+
+	void Push(std::function<void()> job);
+	void Work();
+};
+
+// Read-only view of a whole file, memory mapped where the platform allows it
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool IsOpen() const { return is_open; }
+	std::string_view Data() const { return { data, size }; }
+
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+	bool is_open = false;
+	bool mapped = false;
+	std::string buffer; // Contents when the file could not be mapped
+};
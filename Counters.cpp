@@ -0,0 +1,73 @@
+#include "Counters.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+static int Open(uint32_t type, uint64_t config) {
+	perf_event_attr attr{};
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1; // Allowed with perf_event_paranoid 2
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)); // This thread on any cpu
+}
+
+static uint64_t Cache(uint64_t cache) {
+	return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+#endif
+
+PerfCounters::PerfCounters() {
+	fds.fill(-1);
+#ifdef __linux__
+	fds[Cycles] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	if (fds[Cycles] < 0) error = strerror(errno);
+	fds[Instructions] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	fds[BranchMisses] = Open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+	fds[L1Misses] = Open(PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_L1D));
+	fds[LlcMisses] = Open(PERF_TYPE_HW_CACHE, Cache(PERF_COUNT_HW_CACHE_LL));
+	if (IsAnyAvailable()) error.clear();
+	else if (error.empty()) error = "no counter could be opened";
+#else
+	error = "perf_event_open is available on Linux only";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+	for (int fd : fds)
+		if (fd >= 0) close(fd);
+#endif
+}
+
+bool PerfCounters::IsAnyAvailable() const {
+	return any_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+}
+
+PerfCounters::Values PerfCounters::Read() const {
+	Values values{};
+#ifdef __linux__
+	for (size_t i = 0; i < Count; ++i) {
+		uint64_t data[3]; // Value, time enabled, time running
+		if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data)) continue;
+		values[i] = data[2] ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : 0;
+	}
+#endif
+	return values;
+}
+
+const char* PerfCounters::Name(Counter counter) {
+	static const char* names[Count] = { "CYCLES", "INSTR", "BR-MISS", "L1D-MISS", "LLC-MISS" };
+	return names[counter];
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware counters of the calling thread, read through perf_event_open on Linux. Elsewhere, or where
+// the kernel refuses them (containers, perf_event_paranoid), the counters are unavailable and only
+// the time is measured.
+class PerfCounters {
+public:
+	enum Counter { Cycles, Instructions, BranchMisses, L1Misses, LlcMisses, Count };
+	using Values = std::array<uint64_t, Count>;
+
+	PerfCounters();
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool IsAvailable(Counter counter) const { return fds[counter] >= 0; }
+	bool IsAnyAvailable() const;
+	// Why the counters are unavailable, empty if at least one is open
+	const std::string& Error() const { return error; }
+	// Counts since the open, scaled up when the kernel multiplexed the counter
+	Values Read() const;
+
+	static const char* Name(Counter counter);
+
+private:
+	std::array<int, Count> fds;
+	std::string error;
+};
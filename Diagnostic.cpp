@@ -0,0 +1,83 @@
+#include "Diagnostic.h"
+#include <array>
+#include <tuple>
+
+using namespace std;
+
+namespace Parse {
+	static const array<char, 256> symbols = [] {
+		array<char, 256> table{};
+		for (size_t i = 0; i < table.size(); ++i)
+			table[i] = static_cast<char>(i);
+		return table;
+	}();
+
+	string_view Diagnostic::Symbol(char symbol) {
+		return { &symbols[static_cast<unsigned char>(symbol)], 1 };
+	}
+
+	static ostream& LexerMessage(ostream& os, const Diagnostic& diagnostic) {
+		os << "Lexer: Error (line " << diagnostic.position.line << ", col " << diagnostic.position.col << ") : ";
+		switch (diagnostic.kind) {
+		case Diagnostic::Kind::IllegalSymbol:
+			os << "Illegal symbol \'" << diagnostic.first << "\'";
+			break;
+		case Diagnostic::Kind::UnopenedComment:
+			os << "Unopened comment";
+			break;
+		case Diagnostic::Kind::UnclosedComment:
+			os << "Unclosed comment";
+			break;
+		case Diagnostic::Kind::UnclosedConstant:
+			os << "Unclosed constant";
+			break;
+		case Diagnostic::Kind::WrongLeftPart:
+			os << "Wrong left part";
+			break;
+		case Diagnostic::Kind::UnknownWord:
+			os << "Wrong right part : unknown word " << diagnostic.first;
+			break;
+		case Diagnostic::Kind::UnclosedExponent:
+			os << "Wrong right part : unclosed exponent body";
+			break;
+		default:
+			break;
+		}
+		return os << ";";
+	}
+
+	ostream& operator<< (ostream& os, const Diagnostic& diagnostic) {
+		switch (diagnostic.kind) {
+		case Diagnostic::Kind::Expected:
+			return os << "Parser: Error (line " << diagnostic.position.line << ", column " << diagnostic.position.col
+				<< "): \x91" << diagnostic.first << "\x92 expected but \x91" << diagnostic.second << "\x92 found;";
+		case Diagnostic::Kind::UnexpectedEnd:
+			return os << "Parser: Error: The end of the program was found earlier than expected;";
+		case Diagnostic::Kind::TooManyErrors:
+			return os << "Parser: Too many errors, parsing stopped;";
+		case Diagnostic::Kind::RepeatedIdentifier:
+			return os << "Code Generator: Error (line " << diagnostic.position.line << ", column " << diagnostic.position.col
+				<< "): The constant name '" << diagnostic.first << "' is used a second time;";
+		case Diagnostic::Kind::UndeclaredIdentifier:
+			return os << "Code Generator: Error (line " << diagnostic.position.line << ", column " << diagnostic.position.col
+				<< "): The constant '" << diagnostic.first << "' is not declared;";
+		case Diagnostic::Kind::BufferFull:
+			return os << "Compiler: Error: The " << diagnostic.first << " buffer is full;";
+		default:
+			return LexerMessage(os, diagnostic);
+		}
+	}
+
+	bool operator== (const Position& lhs, const Position& rhs) {
+		return tie(lhs.line, lhs.col) == tie(rhs.line, rhs.col);
+	}
+
+	bool operator!= (const Position& lhs, const Position& rhs) {
+		return !(lhs == rhs);
+	}
+
+	ostream& operator<< (ostream& os, const Position& elem) {
+		os << "[" << elem.line << "; " << elem.col << "]";
+		return os;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <ostream>
+#include <string_view>
+
+namespace Parse {
+	struct Position {
+		size_t line;
+		size_t col;
+	};
+
+	bool operator== (const Position& lhs, const Position& rhs);
+	bool operator!= (const Position& lhs, const Position& rhs);
+	std::ostream& operator<< (std::ostream& os, const Position& elem);
+
+	// Error record of any compiler phase. Only the kind, the position and views to the
+	// involved text are stored; the message itself is built when the record is printed.
+	struct Diagnostic {
+		enum class Kind {
+			// Lexer
+			IllegalSymbol,        // first - symbol
+			UnopenedComment,
+			UnclosedComment,
+			UnclosedConstant,
+			WrongLeftPart,
+			UnknownWord,          // first - word
+			UnclosedExponent,
+			// Parser
+			Expected,             // first - expected, second - found
+			UnexpectedEnd,
+			TooManyErrors,
+			// Code generator
+			RepeatedIdentifier,   // first - identifier
+			UndeclaredIdentifier, // first - identifier
+			// Fixed buffers compile
+			BufferFull,           // first - buffer
+		};
+
+		Kind kind;
+		Position position{};
+		std::string_view first{};
+		std::string_view second{};
+
+		// View of the single symbol that outlives any lexer or input
+		static std::string_view Symbol(char symbol);
+	};
+
+	std::ostream& operator<< (std::ostream& os, const Diagnostic& diagnostic);
+}
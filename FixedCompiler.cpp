@@ -0,0 +1,51 @@
+#include "FixedCompiler.h"
+#include <memory_resource>
+#include <streambuf>
+
+using namespace std;
+
+namespace Parse {
+	namespace {
+		// The program is read in place
+		class ViewBuffer : public streambuf {
+		public:
+			explicit ViewBuffer(string_view text) {
+				auto data = const_cast<char*>(text.data());
+				setg(data, data, data + text.size());
+			}
+		};
+
+		// Writes into the caller's buffer, the stream goes bad when it is full
+		class FixedOutputBuffer : public streambuf {
+		public:
+			explicit FixedOutputBuffer(FixedBuffer<char>& buffer) { setp(buffer.data, buffer.data + buffer.capacity); }
+			size_t Written() const { return pptr() - pbase(); }
+		};
+	}
+
+	FixedResult CompileFixed(string_view program, CompileBuffers& buffers, const CompileOptions& options) {
+		// The monotonic resource never frees, so the arena only has to hold the peak of one compile
+		pmr::monotonic_buffer_resource arena(buffers.arena.data, buffers.arena.capacity, pmr::null_memory_resource());
+		ViewBuffer input_buffer(program);
+		FixedOutputBuffer output_buffer(buffers.output);
+		istream input(&input_buffer);
+		ostream output(&output_buffer);
+		auto fixed = options;
+		fixed.memory = &arena;
+		fixed.workers = 1; // The arena is not thread-safe
+		FixedResult result;
+		try {
+			result.compiled = CompileProgram(input, output, fixed);
+		}
+		catch (const bad_alloc&) {
+			result.compiled = false;
+			result.full = Diagnostic{ Diagnostic::Kind::BufferFull, {}, "arena" };
+		}
+		if (!output && !result.full) {
+			result.compiled = false;
+			result.full = Diagnostic{ Diagnostic::Kind::BufferFull, {}, "output" };
+		}
+		buffers.output.size = output_buffer.Written();
+		return result;
+	}
+}
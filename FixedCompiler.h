@@ -0,0 +1,38 @@
+#pragma once
+#include "LexerTests.h"
+#include <optional>
+
+namespace Parse {
+	// Array owned by the caller, the compiler sets the size of the output
+	template <class T>
+	struct FixedBuffer {
+		T* data = nullptr;
+		size_t capacity = 0;
+		size_t size = 0;
+
+		FixedBuffer() = default;
+		FixedBuffer(T* data, size_t capacity) : data(data), capacity(capacity) {}
+		template <class Container>
+		explicit FixedBuffer(Container& container) : data(container.data()), capacity(container.size()) {}
+	};
+
+	template <class Container>
+	FixedBuffer(Container&) -> FixedBuffer<typename Container::value_type>;
+
+	// Everything a compile writes to: the arena holds what the lexer, the parser and the generator allocate,
+	// the output gets what CompileProgram prints
+	struct CompileBuffers {
+		FixedBuffer<char> arena;
+		FixedBuffer<char> output;
+	};
+
+	struct FixedResult {
+		bool compiled = false;           // Without errors, as the result of CompileProgram
+		std::optional<Diagnostic> full;  // BufferFull naming the buffer that ran out, the output is then cut short
+	};
+
+	// Compiles the program as CompileProgram does with the options, but allocates only from the arena and
+	// on a single thread, so no heap allocation is made. The parse table of -t is built before main; a prelude
+	// must be loaded before, and while tracing (-T, -P) Trace::Prepare must have been called on the thread.
+	FixedResult CompileFixed(std::string_view program, CompileBuffers& buffers, const CompileOptions& options = {});
+}
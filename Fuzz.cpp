@@ -0,0 +1,21 @@
+// libFuzzer entry point, built apart from Lexer.exe with the other sources except main.cpp:
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address Fuzz.cpp <sources> -o fuzz
+//   ./fuzz -dict=tests/corpus/signal.dict tests/corpus
+// An input whose compile takes longer than the budget of CompileCost aborts, so libFuzzer keeps it
+// as a crash; minimize it with -minimize_crash=1, add it to tests/corpus and corpus.txt, then
+// Lexer.exe -b replays it.
+#include "LexerTests.h"
+#include <cstdlib>
+
+using namespace std;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	string_view program(reinterpret_cast<const char*>(data), size);
+	auto cost = MeasureCompile(program);
+	if (cost.IsOverBudget()) {
+		cerr << "Slow input: " << size << " bytes compiled in " << cost.elapsed.count() << " ns, the budget is "
+			<< cost.budget.count() << " ns" << endl;
+		abort();
+	}
+	return 0;
+}
@@ -1,89 +1,310 @@
 #include "Generator.h"
+#include "Prelude.h"
 #include <cmath>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include "Trace.h"
 
 using namespace std;
 using namespace Parse;
 
-void Generator::ParseTree(shared_ptr<Parser::Node> node, const string& nonterm) const {
-	if (node->not_term.has_value())
-		if (node->not_term == nonterm) throw node;
-	for (auto& child : node->children)
-		ParseTree(child, nonterm);
-}
-
-
-shared_ptr<Parser::Node> Generator::FindNonTerm(const string& nonterm) const {
-	try {
-		ParseTree(tree, nonterm);
-	}
-	catch (shared_ptr<Parser::Node> node) {
-		return node;
+// First node of the nonterminal in preorder
+shared_ptr<Parser::Node> Generator::FindNonTerm(string_view nonterm) const {
+	pmr::vector<shared_ptr<Parser::Node>> stack({ tree }, memory);
+	while (!stack.empty()) {
+		auto node = move(stack.back());
+		stack.pop_back();
+		if (node->not_term == nonterm) return node;
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
 	}
 	return {};
 }
 
+bool Generator::Declare(SymbolId symbol, size_t identifier) {
+	if (symbol >= declared.size()) declared.resize(symbol + 1, none);
+	if (declared[symbol] != none) return false;
+	declared[symbol] = identifier;
+	return true;
+}
+
 void Generator::ProcedureIdentifier() {
 	auto procedure_identifier = FindNonTerm("<procedure-identifier>");
-	string identifier(procedure_identifier->children.front()->children.front()->term.value()->value); // Procedure name;
-	identifiers[identifier] = Identifier{ identifier, false };
-	identifiers_order.emplace_back(identifier);
+	auto lexeme = procedure_identifier->children.front()->children.front()->term.value(); // Procedure name;
+	Declare(lexeme->symbol, identifiers.size());
+	identifiers.push_back(Identifier{ lexeme->value, false });
 }
 
-size_t Generator::Constant(shared_ptr<Parser::Node> node) {
-	auto complex = node->term.value()->complex.value();
+size_t Generator::Qwords(const Complex& complex, array<uint64_t, 2>& qwords) {
 	if (complex.left.has_value() && complex.exp.has_value()) {
-		offset += 8;
-		assembly << "mov QWORD PTR[rbp - " + to_string(offset) + "], " +
-			to_string(static_cast<uint64_t>(complex.left.value() * pow(10, complex.exp.value()))) +"\n";
-		return 8;
+		qwords[0] = static_cast<uint64_t>(complex.left.value() * pow(10, complex.exp.value()));
+		return 1;
 	}
-	else if (complex.left.has_value() && !complex.right.has_value()) {
-		offset += 8;
-		assembly << "mov QWORD PTR[rbp - " + to_string(offset) + "], " +
-			to_string(complex.left.value()) + "\n";
-		return 8;
+	if (complex.left.has_value() && !complex.right.has_value()) {
+		qwords[0] = complex.left.value();
+		return 1;
 	}
 	if (complex.right.has_value()) {
-		offset += 8;
-		assembly << "mov QWORD PTR[rbp - " + to_string(offset + 8) + "], " + to_string(complex.right.value()) + "\n";
-		assembly << "mov QWORD PTR[rbp - " + to_string(offset) + "], " + to_string(complex.left.value()) + "\n";
-		offset += 8;
-		return 16;
+		qwords = { complex.right.value(), complex.left.value() };
+		return 2;
 	}
 	return 0;
 }
 
-void Generator::ConstantDeclarations(shared_ptr<Parser::Node> node) {
-	auto lexeme = node->children.front()->children.front()->children.front()->term.value();
-	string identifier(lexeme->value); // Const identifier;
-	if (identifiers.count(identifier)) throw GenerateError("Code Generator: Error (line " + to_string(lexeme->position.line)
-		+ ", column " + to_string(lexeme->position.col) + "): The constant name '" + identifier + "' is used a second time;");
-	assembly << "; " << identifier << endl;
-	identifiers[identifier] = Identifier{ identifier, true, offset,
-		Constant(node->children[2]->children.front()) };
-	identifiers_order.emplace_back(identifier);
-	return;
+size_t Generator::ConstantSize(const Complex& complex) {
+	array<uint64_t, 2> qwords;
+	return Qwords(complex, qwords) * 8;
 }
 
-void Generator::Constants() {
+// Stores the constant below the given offset of the frame
+void Generator::Constant(pmr::vector<Instruction>& code, const Complex& complex, size_t offset) {
+	array<uint64_t, 2> qwords;
+	size_t count = Qwords(complex, qwords);
+	for (size_t i = 0; i < count; ++i)
+		code.push_back({ Instruction::Op::Mov, Operand::Frame(offset + (count - i) * 8), Operand::Immediate(qwords[i]) });
+}
+
+// Table entries of the constant, from the lowest address
+void Generator::ConstantData(pmr::vector<Instruction>& data, const Complex& complex) {
+	array<uint64_t, 2> qwords;
+	size_t count = Qwords(complex, qwords);
+	for (size_t i = 0; i < count; ++i)
+		data.push_back({ Instruction::Op::Dq, Operand::Immediate(qwords[i]) });
+}
+
+// Instructions that fill a frame of the given size
+size_t Generator::Instructions(size_t qwords) {
+	return qwords < table_threshold ? qwords : 4;
+}
+
+// Collects the declarations in source order up to the first repeated name
+bool Generator::ConstantDeclarations(pmr::vector<Declaration>& declarations) {
 	auto constants = FindNonTerm("<constant-declarations>");
 	if (constants->children.size() == 1) // -> empty
+		return true;
+	auto declarations_list = constants->children[1];
+	while (declarations_list->children.size() > 1) {
+		auto node = declarations_list->children.front();
+		auto lexeme = node->children.front()->children.front()->children.front()->term.value();
+		if (!Declare(lexeme->symbol, identifiers.size() + declarations.size())) {
+			errors.push_back({ Diagnostic::Kind::RepeatedIdentifier, lines.Resolve(lexeme->offset), lexeme->value });
+			return false;
+		}
+		declarations.push_back({ lexeme, &node->children[2]->children.front()->term.value()->complex.value() });
+		declarations_list = declarations_list->children.back();
+	}
+	return true;
+}
+
+// Values are compared after the evaluation, so '1000' and '1 $EXP(3)' are the same constant
+void Generator::Pool(pmr::vector<Declaration>& declarations) {
+	pmr::map<tuple<size_t, uint64_t, uint64_t>, size_t> owners(memory);
+	size_t qwords_before = 0;
+	for (size_t i = 0; i < declarations.size(); ++i) {
+		array<uint64_t, 2> qwords{};
+		size_t count = Qwords(*declarations[i].constant, qwords);
+		qwords_before += count;
+		if (!count) continue;
+		auto [owner, added] = owners.emplace(make_tuple(count, qwords[0], qwords[1]), i);
+		if (added) continue;
+		declarations[i].alias = owner->second;
+		pooling.folded++;
+		pooling.frame_bytes += count * 8;
+	}
+	size_t qwords_after = qwords_before - pooling.frame_bytes / 8;
+	pooling.instructions = static_cast<ptrdiff_t>(Instructions(qwords_before)) - static_cast<ptrdiff_t>(Instructions(qwords_after));
+}
+
+// The offsets are a prefix sum of the sizes, so after the sizes of the chunks are summed
+// every chunk is emitted into its own buffer independently of the others
+void Generator::Constants() {
+	pmr::vector<Declaration> declarations(memory);
+	if (!ConstantDeclarations(declarations) && declarations.empty()) return;
+	if (pool_constants) Pool(declarations);
+	size_t start = offset; // The end of the prelude's constants
+
+	size_t first = identifiers.size();
+	identifiers.resize(first + declarations.size());
+	size_t chunks_count = 1;
+	if (declarations.size() >= parallel_threshold) {
+		size_t workers = grammar->workers ? grammar->workers : thread::hardware_concurrency();
+		chunks_count = max<size_t>(1, min<size_t>(workers, declarations.size() / (parallel_threshold / 4)));
+	}
+	pmr::vector<size_t> borders(chunks_count + 1, memory);
+	for (size_t i = 0; i <= chunks_count; ++i)
+		borders[i] = declarations.size() * i / chunks_count;
+
+	auto for_chunks = [chunks_count](auto&& work) {
+		if (chunks_count == 1) return work(0);
+		vector<future<void>> chunks;
+		for (size_t i = 0; i < chunks_count; ++i)
+			chunks.push_back(async(launch::async, work, i));
+		for (auto& chunk : chunks)
+			chunk.get();
+	};
+
+	pmr::vector<size_t> chunk_offsets(chunks_count + 1, offset, memory);
+	for_chunks([&](size_t chunk) {
+		size_t size = 0;
+		for (size_t i = borders[chunk]; i < borders[chunk + 1]; ++i) {
+			identifiers[first + i] = Identifier{ declarations[i].name->value, true, size,
+				ConstantSize(*declarations[i].constant) };
+			if (declarations[i].alias == none) size += identifiers[first + i].size;
+		}
+		chunk_offsets[chunk + 1] = size;
+	});
+	for (size_t i = 1; i <= chunks_count; ++i)
+		chunk_offsets[i] += chunk_offsets[i - 1];
+	offset = chunk_offsets.back();
+	for_chunks([&](size_t chunk) {
+		for (size_t i = borders[chunk]; i < borders[chunk + 1]; ++i)
+			identifiers[first + i].offset += chunk_offsets[chunk];
+	});
+	for (size_t i = 0; i < declarations.size(); ++i) // The owners are declared earlier, so their offsets are final
+		if (declarations[i].alias != none)
+			identifiers[first + i].offset = identifiers[first + declarations[i].alias].offset;
+
+	auto comment = [&](size_t i) { // Const identifier, an alias is followed by its owner
+		if (declarations[i].alias == none) return Instruction::Note(identifiers[first + i].name);
+		return Instruction::Note(identifiers[first + i].name, " = ", identifiers[first + declarations[i].alias].name);
+	};
+	pmr::vector<pmr::vector<Instruction>> listings(chunks_count, memory);
+	if ((offset - start) / 8 < table_threshold) {
+		for_chunks([&](size_t chunk) {
+			for (size_t i = borders[chunk]; i < borders[chunk + 1]; ++i) {
+				listings[chunk].push_back(comment(i));
+				if (declarations[i].alias == none)
+					Constant(listings[chunk], *declarations[i].constant, identifiers[first + i].offset);
+			}
+		});
+		for (auto& listing : listings)
+			code.insert(code.end(), make_move_iterator(listing.begin()), make_move_iterator(listing.end()));
 		return;
-	try {
-		auto declarations_list = constants->children[1];
-		while (declarations_list->children.size() > 1) {
-			ConstantDeclarations(declarations_list->children.front());
-			declarations_list = declarations_list->children.back();
+	}
+
+	// The table is in frame order: the last declared constant has the lowest address
+	for_chunks([&](size_t chunk) {
+		for (size_t i = borders[chunk + 1]; i-- > borders[chunk];) {
+			listings[chunk].push_back(comment(i));
+			if (declarations[i].alias == none)
+				ConstantData(listings[chunk], *declarations[i].constant);
 		}
+	});
+	for (auto listing = listings.rbegin(); listing != listings.rend(); ++listing)
+		data.insert(data.end(), listing->begin(), listing->end());
+	code.push_back({ Instruction::Op::Lea, Operand::Register("rsi"), Operand::Symbol(table_label) });
+	code.push_back({ Instruction::Op::Lea, Operand::Register("rdi"), Operand::Frame(offset, {}) });
+	code.push_back({ Instruction::Op::Mov, Operand::Register("rcx"), Operand::Immediate((offset - start) / 8) });
+	code.push_back({ Instruction::Op::RepMovsq });
+}
+
+// IN reads the port whose number is the value of the constant, the empty constant is port 0.
+// The IN of dead code is only checked
+void Generator::In(pmr::vector<Instruction>& code, shared_ptr<Parser::Node> identifier, bool live) {
+	auto lexeme = identifier->children.front()->term.value();
+	auto index = lexeme->symbol < declared.size() ? declared[lexeme->symbol] : none;
+	if (index == none || !identifiers[index].is_const) {
+		errors.push_back({ Diagnostic::Kind::UndeclaredIdentifier, lines.Resolve(lexeme->offset), lexeme->value });
+		return;
 	}
-	catch (GenerateError& err) {
-		errors.push_back(err.what());
+	if (!live) return;
+	in_targets.push_back(identifiers[index]);
+	code.push_back(Instruction::Note("IN ", lexeme->value));
+	auto rdx = Operand::Register("rdx"), edx = Operand::Register("edx");
+	if (identifiers[index].size) // The left part of a complex constant
+		code.push_back({ Instruction::Op::Mov, rdx, Operand::Frame(identifiers[index].offset + 8) });
+	else
+		code.push_back({ Instruction::Op::Xor, edx, edx });
+	code.push_back({ Instruction::Op::In, Operand::Register("eax"), Operand::Register("dx") });
+}
+
+// Returns whether the end of the list is reachable. A loop is left only by RETURN, so whatever
+// follows a loop or a RETURN in the same list is dead: it is still checked, but nothing of it is generated.
+// The body of a loop falls through to its only jump back, which is dropped too when the body cannot reach it.
+// Only the loops with a jump back get a label, numbered in the order the loops end
+bool Generator::Statements(pmr::vector<Instruction>& code, shared_ptr<Parser::Node> list, bool in_loop, bool live) {
+	bool reachable = true;
+	for (; list->children.size() > 1; list = list->children.back()) {
+		auto statement = list->children.front();
+		auto key_word = statement->children.front()->term.value()->value;
+		bool generated = live && reachable;
+		if (key_word == "LOOP") {
+			pmr::vector<Instruction> body(memory);
+			bool back_edge = Statements(body, statement->children[1], true, generated);
+			if (generated) {
+				auto label = back_edge ? Operand::Symbol("@loop", ++loops) : Operand{};
+				if (back_edge) code.push_back({ Instruction::Op::Label, label });
+				code.insert(code.end(), make_move_iterator(body.begin()), make_move_iterator(body.end()));
+				if (back_edge) code.push_back({ Instruction::Op::Jmp, label });
+			}
+			reachable = false;
+		}
+		else if (key_word == "RETURN") {
+			if (generated && in_loop) { // At the top level the epilogue follows anyway
+				code.push_back({ Instruction::Op::Jmp, Operand::Symbol("@return") });
+				early_return = true;
+			}
+			reachable = false;
+		}
+		else if (key_word == "IN")
+			In(code, statement->children[1], generated);
 	}
+	return reachable;
 }
 
 void Generator::Generate() {
-	assembly << "push rbp\nmov rbp, rsp\n";
+	TRACE_SPAN("Generator::Generate");
+	auto rbp = Operand::Register("rbp");
+	code.push_back({ Instruction::Op::Push, rbp });
+	code.push_back({ Instruction::Op::Mov, rbp, Operand::Register("rsp") });
 	ProcedureIdentifier();
+	if (prelude) UsePrelude();
 	Constants();
-	assembly << "pop rbp\nret";
-}
\ No newline at end of file
+	if (errors.empty()) Statements(code, FindNonTerm("<statements-list>"), false, true);
+	if (early_return) code.push_back({ Instruction::Op::Label, Operand::Symbol("@return") });
+	code.push_back({ Instruction::Op::Pop, rbp });
+	code.push_back({ Instruction::Op::Ret });
+	instructions = { CountInstructions(code), CountInstructions(code) };
+	if (peephole) {
+		Peephole(code, literals);
+		instructions.second = CountInstructions(code);
+	}
+}
+
+void Generator::GeneratePrelude() {
+	table_label = "prelude";
+	Constants();
+}
+
+// The prelude's constants keep their slots and code, the procedure is the only name declared before them
+void Generator::UsePrelude() {
+	const auto& frozen = prelude->GetGenerator();
+	size_t first = identifiers.size();
+	for (SymbolId symbol = 0; symbol < frozen.declared.size(); ++symbol)
+		if (frozen.declared[symbol] != none && !Declare(symbol, first + frozen.declared[symbol])) {
+			auto lexeme = FindNonTerm("<procedure-identifier>")->children.front()->children.front()->term.value();
+			errors.push_back({ Diagnostic::Kind::RepeatedIdentifier, lines.Resolve(lexeme->offset), lexeme->value });
+		}
+	identifiers.insert(identifiers.end(), frozen.identifiers.begin(), frozen.identifiers.end());
+	offset = frozen.offset;
+	code.insert(code.end(), frozen.code.begin(), frozen.code.end());
+}
+
+void Generator::WriteListing(ostream& output) const {
+	for (size_t i = 0; i < code.size(); ++i)
+		output << (i ? "\n" : "") << code[i];
+	const pmr::vector<Instruction> no_data;
+	const auto& prelude_data = prelude ? prelude->GetGenerator().data : no_data;
+	if (data.empty() && prelude_data.empty() && literals.empty()) return;
+	output << "\n\nsection .rodata";
+	for (auto [label, table] : { make_pair("prelude", &prelude_data), make_pair("constants", &data) }) {
+		if (table->empty()) continue;
+		output << "\n" << label << ":";
+		for (const auto& entry : *table)
+			output << "\n" << entry;
+	}
+	for (size_t i = 0; i < literals.size(); ++i)
+		output << "\n" << Operand::Symbol("literal", i) << ":\ndq " << literals[i].low << "\ndq " << literals[i].high;
+}
@@ -1,45 +1,103 @@
 #pragma once
 #include "Parser.h"
-#include <sstream>
+#include "Assembly.h"
+#include <ostream>
+#include <array>
 
 namespace Parse {
-	class GenerateError : public std::runtime_error {
-	public:
-		using std::runtime_error::runtime_error;
+	class Prelude;
+
+	struct GeneratorOptions {
+		bool pool_constants = false;     // Constants of equal value share one slot of the frame
+		bool peephole = false;           // Optimize the code with Peephole()
+		const Prelude* prelude = nullptr; // Constants declared before the program's, the lexer must use its grammar
 	};
 
 	class Generator {
 	public:
-		Generator(std::shared_ptr<Parser::Node> tree) : tree(tree) {};
+		// Sections with at least this many constants are emitted by worker threads
+		static constexpr size_t parallel_threshold = 1 << 12;
+		// Frames of at least this many qwords are filled from a read-only table by a block copy
+		// instead of a store per constant
+		static constexpr size_t table_threshold = 32;
+
+		// The code and the errors are allocated from the memory of the grammar
+		Generator(std::shared_ptr<Grammar> grammar, std::shared_ptr<Parser::Node> tree, const LineIndex& lines,
+			const GeneratorOptions& options = {})
+			: grammar(grammar), memory(grammar->memory), code(memory), data(memory), literals(memory), tree(tree), lines(lines),
+			pool_constants(options.pool_constants), peephole(options.peephole), prelude(options.prelude), errors(memory),
+			identifiers(memory), declared(memory), in_targets(memory) {};
+
+		// What the pooling saved compared to a slot per constant
+		struct PoolingReport {
+			size_t folded = 0;          // Constants that became aliases
+			size_t frame_bytes = 0;
+			ptrdiff_t instructions = 0; // Negative if the smaller frame falls back from the block copy to the stores
+		};
 
 		void Generate();
-		std::string GetListing() const { return assembly.str(); }
+		// Only the constants, from the bottom of the frame; a large table is labeled prelude
+		void GeneratePrelude();
+		void WriteListing(std::ostream& output) const;
 		const auto& GetIdentifiers() const { return identifiers; }
-		const auto& GetIdentifiersOrder() const { return identifiers_order; }
+		const auto& GetInTargets() const { return in_targets; }
 		const auto& GetErrors() const { return errors; }
+		const PoolingReport& GetPooling() const { return pooling; }
+		// Instructions before and after the peephole pass
+		std::pair<size_t, size_t> GetInstructionsCount() const { return instructions; }
 	private:
-		std::stringstream assembly;
+		std::shared_ptr<Grammar> grammar;
+		std::pmr::memory_resource* memory;
+		std::pmr::vector<Instruction> code;
+		std::pmr::vector<Instruction> data;     // Constants table in frame order
+		std::pmr::vector<Literal> literals;     // Added by the peephole pass
+		std::pair<size_t, size_t> instructions;
 		std::shared_ptr<Parser::Node> tree;
+		const LineIndex& lines;
+		bool pool_constants;
+		bool peephole;
+		const Prelude* prelude;
+		std::string_view table_label = "constants";
+		PoolingReport pooling;
 
-		std::vector<std::string> errors;
+		std::pmr::vector<Diagnostic> errors;
 
 		struct Identifier {
-			std::string name;
+			std::string_view name;
 			bool is_const = true;
 			size_t offset = 0;
 			size_t size = 0;
 		};
 
 		size_t offset = 0;
-		std::unordered_map<std::string, Identifier> identifiers;
-		std::vector<std::string> identifiers_order;
+		std::pmr::vector<Identifier> identifiers; // In order of declaration
+		std::pmr::vector<size_t> declared;        // Index in identifiers by SymbolId
+		std::pmr::vector<Identifier> in_targets;  // Constants read by IN, in order of the statements
+		size_t loops = 0;
+		bool early_return = false;           // A RETURN inside a loop jumps to the epilogue
+
+		using Complex = Lexer::Complex;
+		static constexpr size_t none = SIZE_MAX;
+		struct Declaration {
+			LexemeIt name;
+			const Complex* constant;
+			size_t alias = none; // Earlier declaration of the same value whose slot is shared
+		};
 
-		std::shared_ptr<Parser::Node> FindNonTerm(const std::string& nonterm) const;
-		void ParseTree(std::shared_ptr<Parser::Node> node, const std::string& nonterm) const;
+		std::shared_ptr<Parser::Node> FindNonTerm(std::string_view nonterm) const;
+		bool Declare(SymbolId symbol, size_t identifier);
 
-		void ConstantDeclarations(std::shared_ptr<Parser::Node> node);
-		size_t Constant(std::shared_ptr<Parser::Node> node);
+		static size_t Qwords(const Complex& constant, std::array<uint64_t, 2>& qwords);
+		static size_t ConstantSize(const Complex& constant);
+		static void Constant(std::pmr::vector<Instruction>& code, const Complex& constant, size_t offset);
+		static void ConstantData(std::pmr::vector<Instruction>& data, const Complex& constant);
+		static size_t Instructions(size_t qwords);
+		bool ConstantDeclarations(std::pmr::vector<Declaration>& declarations);
+		void Pool(std::pmr::vector<Declaration>& declarations);
 		void Constants();
 		void ProcedureIdentifier();
+		void UsePrelude();
+		bool Statements(std::pmr::vector<Instruction>& code, std::shared_ptr<Parser::Node> list, bool in_loop, bool live);
+		void In(std::pmr::vector<Instruction>& code, std::shared_ptr<Parser::Node> identifier, bool live);
 	};
 }
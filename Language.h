@@ -0,0 +1,118 @@
+#pragma once
+#include <unordered_map>
+#include <string_view>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <array>
+#include <optional>
+#include "SymbolTable.h"
+
+namespace Parse {
+	// The language and what the phases of one compile share: the symbols, the memory everything of the compile
+	// is allocated from and the number of threads it may use
+	struct Grammar {
+		explicit Grammar(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+			: memory(memory), key_words(memory), symbols(memory), tokens_value(memory) {}
+
+		std::pmr::memory_resource* memory;
+		size_t workers = 0; // Threads of the long CONST sections, 0 - one per core; 1 if the memory is not thread-safe
+		std::pmr::unordered_map<std::pmr::string, Code> key_words;
+		SymbolTable symbols; // Identifiers and constants of the program
+		size_t identifiers_count = 0;
+		size_t constants_count = 0;
+		std::pmr::unordered_map<Code, std::pmr::string> tokens_value;
+		std::array<size_t, 256> symbols_attributes{ 10 };
+		Code identifier_code = 1001;
+		Code constant_code = 501;
+	};
+
+	struct KeyWord {
+		std::string_view name;
+		Code code;
+	};
+
+	// Symbol classes of the signal language:
+	// 0 - whitespace, 1 - digit, 2 - letter, 3 - delimiter, 4 - comment, 5 - exponent, 6 - constant, 10 - illegal
+	constexpr std::array<unsigned char, 256> MakeAttributes(std::string_view delimiters) {
+		std::array<unsigned char, 256> attributes{};
+		for (size_t i = 0; i < attributes.size(); ++i) {
+			attributes[i] = 10;
+			if ((i >= 'A' && i <= 'Z'))
+				attributes[i] = 2;
+			else if (i >= '0' && i <= '9')
+				attributes[i] = 1;
+			if ((i >= 9 && i <= 13) || (i >= 'a' && i <= 'z') || i == ' ')
+				attributes[i] = 0;
+		}
+		attributes['('] = 4;
+		attributes['$'] = 5;
+		attributes['\''] = 6;
+		for (char delimiter : delimiters)
+			attributes[static_cast<unsigned char>(delimiter)] = 3;
+		return attributes;
+	}
+
+	// Compile-time description of the language accepted by the compiler
+	struct SignalLanguage {
+		static constexpr std::array<KeyWord, 8> key_words{ {
+			{ "PROGRAM", 401 },
+			{ "BEGIN", 402 },
+			{ "END", 403 },
+			{ "CONST", 404 },
+			{ "LOOP", 405 },
+			{ "ENDLOOP", 406 },
+			{ "RETURN", 407 },
+			{ "IN", 408 },
+		} };
+		static constexpr std::string_view delimiters = "=;.";
+		static constexpr std::array<unsigned char, 256> symbols_attributes = MakeAttributes(delimiters);
+		static constexpr Code identifier_code = 1001;
+		static constexpr Code constant_code = 501;
+	};
+
+	// Lexer policy that reads the language from the runtime Grammar
+	struct DynamicLanguage {
+		static size_t Attribute(const Grammar& grammar, char symbol) {
+			return grammar.symbols_attributes[static_cast<unsigned char>(symbol)];
+		}
+
+		static std::optional<KeyWord> FindKeyWord(const Grammar& grammar, std::string_view word) {
+			auto it = grammar.key_words.find(std::pmr::string(word, grammar.memory));
+			if (it == grammar.key_words.end()) return {};
+			return KeyWord{ it->first, it->second };
+		}
+
+		static Code IdentifierCode(const Grammar& grammar) { return grammar.identifier_code; }
+		static Code ConstantCode(const Grammar& grammar) { return grammar.constant_code; }
+	};
+
+	// Lexer policy over a constexpr description, the Grammar is used only for the identifier and constant tables
+	template <class Description>
+	struct StaticLanguage {
+		static constexpr size_t Attribute(const Grammar&, char symbol) {
+			return Description::symbols_attributes[static_cast<unsigned char>(symbol)];
+		}
+
+		static constexpr std::optional<KeyWord> FindKeyWord(const Grammar&, std::string_view word) {
+			for (const auto& key_word : Description::key_words)
+				if (key_word.name == word) return key_word;
+			return {};
+		}
+
+		static constexpr Code IdentifierCode(const Grammar&) { return Description::identifier_code; }
+		static constexpr Code ConstantCode(const Grammar&) { return Description::constant_code; }
+	};
+
+	template <class Description>
+	std::shared_ptr<Grammar> MakeGrammar(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+		auto grammar = std::allocate_shared<Grammar>(std::pmr::polymorphic_allocator<Grammar>(memory), memory);
+		for (size_t i = 0; i < grammar->symbols_attributes.size(); ++i)
+			grammar->symbols_attributes[i] = Description::symbols_attributes[i];
+		for (const auto& key_word : Description::key_words)
+			grammar->key_words.emplace(key_word.name, key_word.code);
+		grammar->identifier_code = Description::identifier_code;
+		grammar->constant_code = Description::constant_code;
+		return grammar;
+	}
+}
@@ -4,18 +4,60 @@
 #include <string>
 #include <cmath>
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include "Trace.h"
 
 using namespace std;
 
 namespace Parse {
-	char Reader::get() {
-		if (input.peek() == '\n') {
-			line_++;
-			col_ = 1;
+	void LineIndex::Scan(const char* data, size_t size, size_t offset) {
+		for (auto next = data, end = data + size; (next = static_cast<const char*>(memchr(next, '\n', end - next))); ++next)
+			line_starts.push_back(offset + (next - data) + 1);
+		for (auto next = data, end = data + size; (next = static_cast<const char*>(memchr(next, '\t', end - next))); ++next)
+			tabs.push_back(offset + (next - data));
+	}
+
+	Position LineIndex::Resolve(size_t offset) const {
+		auto line = prev(upper_bound(line_starts.begin(), line_starts.end(), offset));
+		auto tabs_before = lower_bound(tabs.begin(), tabs.end(), offset) - lower_bound(tabs.begin(), tabs.end(), *line);
+		if (line == line_starts.begin()) tabs_before += discarded_tabs;
+		return { discarded_lines + (line - line_starts.begin()) + 1,
+			1 + (offset - *line) + (TAB_SIZE - 1) * static_cast<size_t>(tabs_before) };
+	}
+
+	void LineIndex::Discard(size_t offset) {
+		while (line_starts.size() > 1 && line_starts[1] <= offset) {
+			line_starts.pop_front();
+			discarded_lines++;
+			discarded_tabs = 0; // The tabs discarded before are all on the lines before
 		}
-		else if (input.peek() == '\t') col_ += TAB_SIZE;
-		else col_++;
-		return input.get();
+		for (; !tabs.empty() && tabs.front() < offset; tabs.pop_front())
+			if (tabs.front() >= line_starts.front()) discarded_tabs++;
+	}
+
+	void Reader::KeepFrom(size_t offset) {
+		discarding = true;
+		kept = offset;
+	}
+
+	bool Reader::Refill() {
+		if (discarding) lines_.Discard(min(kept, offset_));
+		input.read(window.data(), window.size());
+		window_begin = 0;
+		window_end = static_cast<size_t>(input.gcount());
+		read_ += window_end;
+		lines_.Scan(window.data(), window_end, offset_);
+		return window_end;
+	}
+
+	char Reader::get() {
+		char next = peek();
+		if (window_begin == window_end) failed = true;
+		else window_begin++;
+		offset_++;
+		return next;
 	}
 
 	void Reader::ignore() {
@@ -23,27 +65,36 @@ namespace Parse {
 	}
 
 	char Reader::peek() {
-		return input.peek();
+		if (window_begin == window_end && !Refill()) return static_cast<char>(Eof);
+		return window[window_begin];
 	}
 
-	size_t Reader::line() const { return line_; }
+	size_t Reader::offset() const { return offset_; }
 
-	size_t Reader::col() const { return col_; }
+	size_t Reader::size() const { return read_; }
 
-	Position Reader::position() const { return { line_, col_ }; }
+	Position Reader::position() const { return lines_.Resolve(offset_); }
 
-	void Lexer::Whitespace() {
+	LineIndex& Reader::lines() { return lines_; }
+
+	const LineIndex& Reader::lines() const { return lines_; }
+
+	template <class Language>
+	void BasicLexer<Language>::Whitespace() {
 		char next;
-		while (!grammar->symbols_attributes[next = program.peek()]) {
+		while (!Language::Attribute(*grammar, next = program.peek())) {
 			if (next == '\n') row++;
 			program.ignore();
 			if (program.peek() == Eof) break;
 		}
 	}
 
-	void Lexer::Comment() {
+	void LexerBase::Comment() {
 		program.ignore();
-		if (program.peek() != '*') ThrowErr("Unopened comment");
+		if (program.peek() != '*') {
+			AddErr(Diagnostic::Kind::UnopenedComment);
+			return;
+		}
 		bool met_an_asterisk = false;
 		char next;
 		while (program) {
@@ -52,34 +103,34 @@ namespace Parse {
 				return;
 			met_an_asterisk = (next == '*');
 		}
-		ThrowErr("Unclosed comment");
+		AddErr(Diagnostic::Kind::UnclosedComment);
 	}
 
-	void Lexer::Delimiter() {
-		auto begin = program.position();
-		Tokens().emplace_back(static_cast<Code>(program.get()), begin);
+	void LexerBase::Delimiter() {
+		auto begin = program.offset();
+		Emit({ static_cast<Code>(program.get()), begin });
 	}
 
-	void Lexer::KeywordOrIdentifier() {
-		auto begin = program.position();
-		string buffer;
+	template <class Language>
+	void BasicLexer<Language>::KeywordOrIdentifier() {
+		auto begin = program.offset();
+		pmr::string buffer(grammar->memory);
 		char next;
 		while (program) {
 			next = program.peek();
 			if (isalnum(next)) buffer += program.get();
 			else break;
 		}
-		if (grammar->key_words.count(buffer)) {
-			Tokens().emplace_back(grammar->key_words[buffer], begin, grammar->key_words.find(buffer)->first);
+		if (auto key_word = Language::FindKeyWord(*grammar, buffer)) {
+			Emit({ key_word->code, begin, key_word->name });
 		}
 		else {
-			grammar->identifiers.try_emplace(buffer,
-				grammar->identifier_code + grammar->identifiers.size());
-			Tokens().emplace_back(grammar->identifiers[buffer], begin, grammar->identifiers.find(buffer)->first);
+			Emit(Intern(TokenKind::Identifier, begin, buffer, Language::IdentifierCode(*grammar), grammar->identifiers_count));
 		}
 	}
 
-	optional<double> Lexer::LeftPart(string& buffer) {
+	template <class Language>
+	bool BasicLexer<Language>::LeftPart(pmr::string& buffer, optional<uint64_t>& part) {
 		while (program) {
 			if (isdigit(program.peek())) {
 				buffer += program.peek();
@@ -87,30 +138,38 @@ namespace Parse {
 			}
 			else {
 				char next = program.peek();
-				if (!grammar->symbols_attributes[next] || next == '\'') 
-					if (buffer.size()) return atoi(buffer.c_str());
-					else return {};
-				ThrowErr("Wrong left part");
+				if (!Language::Attribute(*grammar, next) || next == '\'') 
+					break;
+				AddErr(Diagnostic::Kind::WrongLeftPart);
+				return false;
 			}
 		}
+		if (buffer.size()) part = atoi(buffer.c_str());
+		return true;
 	}
 
-	void Lexer::RightPart(Complex& complex, string& buffer) {
-		if (isdigit(program.peek())) {
-			complex.right = LeftPart(buffer);
-			return;
-		}
-		string local_buffer;
-		string digit;
+	template <class Language>
+	bool BasicLexer<Language>::RightPart(Complex& complex, pmr::string& buffer) {
+		if (isdigit(program.peek()))
+			return LeftPart(buffer, complex.right);
+		pmr::string local_buffer(grammar->memory);
+		pmr::string digit(grammar->memory);
+		// The word is looked for up to the next '(', possibly far past the constant, so only
+		// its start inside the constant is collected
+		bool closed = false;
 		while (program) {
 			if (program.peek() == '(') {
 				program.ignore();
-				if (local_buffer != "$EXP") 
-					ThrowErr("Wrong right part : unknown word " + local_buffer);
+				if (closed || local_buffer != "$EXP") {
+					AddErr(Diagnostic::Kind::UnknownWord, Payload(local_buffer));
+					return false;
+				}
 				local_buffer += '(';
 				break;
 			}
-			local_buffer += program.get();
+			char next = program.get();
+			closed = closed || next == '\'';
+			if (!closed && local_buffer.size() < word_limit) local_buffer += next;
 		}
 		Whitespace();
 		while (program) {
@@ -121,152 +180,160 @@ namespace Parse {
 			else {
 				Whitespace();
 				if (program.peek() == ')') {
-					buffer += local_buffer + ')';
+					buffer += local_buffer;
+					buffer += ')';
 					program.ignore();
 					complex.exp = atoi(digit.c_str());
-					return;
+					return true;
 				}
-				ThrowErr("Wrong right part : unclosed exponent body");
+				AddErr(Diagnostic::Kind::UnclosedExponent);
+				return false;
 			}
 		}
+		return true;
 	}
 
-	void Lexer::AddErr(std::string&& msg) {
-		Errors().emplace_back(msg);
+	void LexerBase::Emit(LexemesList::Item&& item) {
+		if (sink) sink(item);
+		else Tokens().push_back(move(item));
 	}
 
-	void Lexer::ThrowErr(std::string&& msg) {
-		throw LexerError{ "Lexer: Error (line " + to_string(program.line()) +
-			", col " + to_string(program.col() - 1) + ") : " + msg + ";" };
+	LexerBase::LexemesList::Item LexerBase::Intern(TokenKind kind, size_t offset, string_view name, Code first_code, size_t& count) {
+		auto& symbols = grammar->symbols;
+		SymbolId symbol;
+		if (sink && symbols.Size() >= stream_symbols) { // The table is full, only the known names are found
+			symbol = symbols.Find(name);
+			if (symbol == SymbolTable::none) return { kind, first_code, offset, name, SymbolTable::none };
+		}
+		else {
+			bool added;
+			tie(symbol, added) = symbols.Intern(name, first_code + count);
+			if (added) count++;
+		}
+		return { kind, symbols.GetCode(symbol), offset, symbols.Name(symbol), symbol };
+	}
+
+	void LexerBase::AddErr(Diagnostic::Kind kind, string_view payload) {
+		auto position = program.position();
+		position.col--;
+		if (error_sink) error_sink({ kind, position, payload });
+		else Errors().push_back({ kind, position, payload });
 	}
 
-	void Lexer::Constant() {
-		auto begin = program.position();
+	string_view LexerBase::Payload(pmr::string& text) {
+		if (error_sink) return text;
+		return List().payloads.emplace_back(move(text));
+	}
+
+	template <class Language>
+	void BasicLexer<Language>::Constant() {
+		auto begin = program.offset();
 		Complex complex;
-		string left;
-		string right;
+		pmr::string left(grammar->memory);
+		pmr::string right(grammar->memory);
 		program.get();
-		bool error = 0;
 		Whitespace();
-		try {
-			complex.left = LeftPart(left);
-		}
-		catch (LexerError& ex) {
-			error = true;
-			AddErr(ex.what());
-		}
+		bool error = !LeftPart(left, complex.left);
 		Whitespace();
-		if (program.peek() != '\'' && !error) {
-			try {
-				RightPart(complex, right);
-			}
-			catch (LexerError& ex) {
-				error = true;
-				AddErr(ex.what());
-			}
-		}
+		if (program.peek() != '\'' && !error)
+			error = !RightPart(complex, right);
 		while (program && program.get() != '\'');
-		if (!program) ThrowErr("Unclosed constant");
+		if (!program) {
+			AddErr(Diagnostic::Kind::UnclosedConstant);
+			return;
+		}
 		if (error) return;
 		if (right.size()) left += ' ';
-		string buffer = '\'' + left + right + '\'';
-		grammar->constants.try_emplace(buffer,
-			grammar->constant_code + grammar->constants.size());
-		Tokens().emplace_back(grammar->constants[buffer], begin, grammar->constants.find(buffer)->first);
-		Tokens().back().complex = complex;
+		pmr::string buffer(grammar->memory); // Built in place, a sum of strings would take the default memory
+		buffer += '\'';
+		buffer += left;
+		buffer += right;
+		buffer += '\'';
+		auto item = Intern(TokenKind::Constant, begin, buffer, Language::ConstantCode(*grammar), grammar->constants_count);
+		item.complex = complex;
+		Emit(move(item));
 	}
 	
-	void Lexer::Parse() {
+	template <class Language>
+	void BasicLexer<Language>::Parse() {
 		if (parsed_program.has_value()) return;
-		parsed_program.emplace();
+		TRACE_SPAN("Lexer::Parse");
+		parsed_program.emplace(grammar->memory);
+		List().lines = &program.lines();
 		while(program.peek() != Eof) {
 			char next = program.peek();
-			try {
-				switch (grammar->symbols_attributes[next]) {
-				case 0:
-					Whitespace();
-					break;
-				case 2:
-					KeywordOrIdentifier();
-					break;
-				case 3:
-					Delimiter();
-					break;
-				case 4:
-					Comment();
-					break;
-				case 6:
-					Constant();
-					break;
-				default:
-					program.ignore();
-					stringstream out;
-					out << "Illegal symbol \'" << next << "\'";
-					ThrowErr(out.str());
-				}
-			}
-			catch (LexerError& ex) {
-				AddErr(ex.what());
+			auto attribute = Language::Attribute(*grammar, next);
+			// Tokens before are already passed to the sink, the one read now needs the line of its start.
+			// Whitespace, comments and errors need only the current line, so a long comment keeps no lines
+			if (sink) program.KeepFrom(attribute == 2 || attribute == 3 || attribute == 6 ? program.offset() : Reader::current);
+			switch (attribute) {
+			case 0:
+				Whitespace();
+				break;
+			case 2:
+				KeywordOrIdentifier();
+				break;
+			case 3:
+				Delimiter();
+				break;
+			case 4:
+				Comment();
+				break;
+			case 6:
+				Constant();
+				break;
+			default:
+				program.ignore();
+				AddErr(Diagnostic::Kind::IllegalSymbol, Diagnostic::Symbol(next));
 			}
 		}
 	}
 
-	const Lexer::LexemesList &Lexer::List() const {
+	const LexerBase::LexemesList &LexerBase::List() const {
 		if (parsed_program.has_value())
 			return parsed_program.value();
 		throw bad_optional_access();
 	}
 
-	const std::vector<std::string>& Lexer::GetErrors() const { return List().errors; }
+	const std::pmr::vector<Diagnostic>& LexerBase::GetErrors() const { return List().errors; }
 
-	const std::vector<Lexer::LexemesList::Item>& Lexer::GetTokens() const { return List().items; }
+	const std::pmr::vector<LexerBase::LexemesList::Item>& LexerBase::GetTokens() const { return List().items; }
 
-	Lexer::LexemesList& Lexer::List() {
+	const LineIndex& LexerBase::GetLines() const { return program.lines(); }
+
+	size_t LexerBase::GetInputSize() const { return program.size(); }
+
+	LexerBase::LexemesList& LexerBase::List() {
 		if (parsed_program.has_value())
 			return parsed_program.value();
 		throw bad_optional_access();
 	}
 
-	std::vector<std::string>& Lexer::Errors() { return List().errors; }
+	std::pmr::vector<Diagnostic>& LexerBase::Errors() { return List().errors; }
 
-	std::vector<Lexer::LexemesList::Item>& Lexer::Tokens() { return List().items; }
+	std::pmr::vector<LexerBase::LexemesList::Item>& LexerBase::Tokens() { return List().items; }
 
-	bool operator==(const Lexer::LexemesList::Item& lhs, const Lexer::LexemesList::Item& rhs) {
+	bool operator==(const LexerBase::LexemesList::Item& lhs, const LexerBase::LexemesList::Item& rhs) {
 		if (lhs.code != rhs.code) return false;
-		if (lhs.position != rhs.position) return false;
+		if (lhs.offset != rhs.offset) return false;
 		return true;
 	}
 
-	bool operator==(const Lexer::LexemesList& lhs, const Lexer::LexemesList& rhs) {
+	bool operator==(const LexerBase::LexemesList& lhs, const LexerBase::LexemesList& rhs) {
 		if (lhs.items != rhs.items) return false;
 		return true;
 	}
 
-	std::ostream& operator<<(std::ostream& os, const Lexer::LexemesList& list) {
+	std::ostream& operator<<(std::ostream& os, const LexerBase::LexemesList& list) {
 		os << endl;
 		for (const auto& item : list.items)
 			os << setw(5) << item.code;
 		os << endl;
 		for (const auto& item : list.items)
-			os << setw(5) << item.position;
+			os << setw(5) << list.lines->Resolve(item.offset);
 		return os;
 	}
 
-	std::ostream& operator<<(std::ostream& os, const Lexer::LexemesList::Item& item) {
-		os << item.code << " on position " << item.position;
-		return os;
-	}
-
-	bool operator== (const Position& lhs, const Position& rhs) {
-		return tie(lhs.line, lhs.col) == tie(rhs.line, rhs.col);
-	}
-
-	bool operator!= (const Position& lhs, const Position& rhs) {
-		return !(lhs == rhs);
-	}
-
-	ostream& operator<< (ostream& os, const Position& elem) {
-		os << "[" << elem.line << "; " << elem.col << "]";
-		return os;
-	}
+	template class BasicLexer<DynamicLanguage>;
+	template class BasicLexer<StaticLanguage<SignalLanguage>>;
 }
\ No newline at end of file
@@ -1,73 +1,94 @@
 #pragma once
 #include <ostream>
-#include <unordered_map>
 #include <string_view>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <iostream>
-#include <array>
 #include <vector>
 #include <optional>
-#include <exception>
+#include <deque>
+#include <functional>
+#include "Diagnostic.h"
+#include "Language.h"
 
 #define TAB_SIZE 4
 
 namespace Parse {
-	using Code = size_t;
 	const int Eof = std::istream::traits_type::eof();
 
-	struct Position {
-		size_t line;
-		size_t col;
-	};
-
-	bool operator== (const Position& lhs, const Position& rhs);
-	bool operator!= (const Position& lhs, const Position& rhs);
-	std::ostream& operator<< (std::ostream& os, const Position& elem);
-
-
-	class LexerError : public std::runtime_error {
+	// Offsets of line starts and tabs of the input, used to turn a byte offset into a Position on demand
+	class LineIndex {
 	public:
-		using std::runtime_error::runtime_error;
-	};
+		explicit LineIndex(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+			: line_starts(1, 0, memory), tabs(memory) {}
+
+		void Scan(const char* data, size_t size, size_t offset);
+		Position Resolve(size_t offset) const;
+		// Forgets the lines before the one holding the offset and the tabs before the offset,
+		// positions before it can't be resolved anymore
+		void Discard(size_t offset);
 
-	struct Grammar {
-		std::unordered_map<std::string, Code> key_words;
-		std::unordered_map<std::string, Code> constants;
-		std::unordered_map<std::string, Code> identifiers;
-		std::unordered_map<Code, std::string> tokens_value;
-		std::array<size_t, 255> symbols_attributes{ 10 };
-		const Code identifier_code = 1001;
-		const Code constant_code = 501;
+	private:
+		std::pmr::deque<size_t> line_starts;
+		std::pmr::deque<size_t> tabs;
+		size_t discarded_lines = 0;
+		size_t discarded_tabs = 0; // Of the first line
 	};
 
+	// Reads the input through a fixed-size window that is refilled when it is exhausted,
+	// so the memory used does not depend on the input size
 	class Reader {
 	public:
-		Reader(std::istream& input) : input(input) {}
+		static constexpr size_t default_window = 1 << 16;
+
+		Reader(std::istream& input, size_t window_size = default_window,
+			std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+			: input(input), window(window_size, memory), lines_(memory) {}
 
 		operator Reader() {
 			return input;
 		}
 
 		operator bool() {
-			return static_cast<bool>(input);
+			return !failed;
 		}
 
 		char get();
 		void ignore();
 		char peek();
 
-		size_t line() const;
-		size_t col() const;
+		static constexpr size_t current = SIZE_MAX;
+		// Streaming: only positions from the offset on are resolved, the lines before it are discarded
+		// at the refills. With current nothing before the offset of the refill is kept
+		void KeepFrom(size_t offset);
 
+		size_t offset() const;
+		size_t size() const; // Bytes read from the input so far
 		Position position() const;
+		LineIndex& lines();
+		const LineIndex& lines() const;
 	private:
 		std::istream& input;
-		size_t line_ = 1;
-		size_t col_ = 1;
+		std::pmr::vector<char> window;
+		size_t window_begin = 0;
+		size_t window_end = 0;
+		bool failed = false; // A symbol was requested after the end of the input
+		size_t offset_ = 0;  // Counts every request, including the ones after the end of the input
+		size_t read_ = 0;
+		LineIndex lines_;
+		bool discarding = false;
+		size_t kept = 0;
+
+		bool Refill();
 	};
 
-	class Lexer {
+	// Class of a token. Identifiers and constants get dense codes from the ends of their ranges and both grow
+	// without a bound, so the codes of the two classes may meet; the class is told by the kind
+	enum class TokenKind : unsigned char { Delimiter, KeyWord, Identifier, Constant };
+
+	// Language independent part of the lexer
+	class LexerBase {
 	public:
 		struct Complex {
 			std::optional<uint64_t> left;
@@ -77,52 +98,100 @@ namespace Parse {
 
 		struct LexemesList {
 			struct Item {
-				Item(Code code, Position position, std::string_view value) : code(code), position(position), value(value) {}
-				Item(Code code, Position position) : code(code), position(position) {}
+				Item(Code code, size_t offset, std::string_view value)
+					: kind(TokenKind::KeyWord), code(code), offset(offset), value(value) {}
+				Item(TokenKind kind, Code code, size_t offset, std::string_view value, SymbolId symbol)
+					: kind(kind), code(code), offset(offset), value(value), symbol(symbol) {}
+				Item(Code code, size_t offset) : code(code), offset(offset) {}
 				Item() = default;
 				std::optional<Complex> complex;
+				TokenKind kind = TokenKind::Delimiter;
 				Code code;
-				Position position;
+				size_t offset; // Resolved to a Position with the LineIndex of the lexer
 				std::string_view value;
+				SymbolId symbol = SymbolTable::none; // Identifiers and constants only
 			};
-			std::vector<Item> items;
-			std::vector<std::string> errors;
-		};
-
-		Lexer(std::shared_ptr<Grammar> grammar, std::istream& input) : program(input), grammar(grammar) {};
-
-		void Parse();
+			explicit LexemesList(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+				: items(memory), errors(memory), payloads(memory) {}
 
-		const std::vector<std::string>& GetErrors() const;
-		const std::vector<LexemesList::Item>& GetTokens() const;
+			std::pmr::vector<Item> items;
+			std::pmr::vector<Diagnostic> errors;
+			std::pmr::deque<std::pmr::string> payloads; // Text referenced by errors that is not kept anywhere else
+			const LineIndex* lines = nullptr;
+		};
 
-	private:
+		using Sink = std::function<void(const LexemesList::Item&)>;
+		using ErrorSink = std::function<void(const Diagnostic&)>;
+
+		// Streaming mode keeps at most this many distinct names, the next new ones are not interned
+		static constexpr size_t stream_symbols = 1 << 16;
+		// The payload of an unknown word keeps at most this many characters of it
+		static constexpr size_t word_limit = 64;
+
+		// Everything is allocated from the memory of the grammar
+		LexerBase(std::shared_ptr<Grammar> grammar, std::istream& input, size_t window_size = Reader::default_window)
+			: grammar(grammar), program(input, window_size, grammar->memory) {};
+		// Streaming mode: tokens and errors are passed to the sinks as soon as they are recognized and are not
+		// stored. Values of interned names stay valid while the grammar lives; a name past stream_symbols gets
+		// the first code of its class and no symbol, and it and the error payloads are valid only during the call.
+		LexerBase(std::shared_ptr<Grammar> grammar, std::istream& input, Sink sink, ErrorSink error_sink,
+			size_t window_size = Reader::default_window)
+			: grammar(grammar), program(input, window_size, grammar->memory), sink(std::move(sink)),
+			error_sink(std::move(error_sink)) {};
+
+		const std::pmr::vector<Diagnostic>& GetErrors() const;
+		const std::pmr::vector<LexemesList::Item>& GetTokens() const;
+		const LineIndex& GetLines() const;
+		size_t GetInputSize() const;
+
+	protected:
 		std::shared_ptr<Grammar> grammar;
 		Reader program;
 		std::optional<LexemesList> parsed_program;
 		size_t row = 0;
+		Sink sink;
+		ErrorSink error_sink;
 
-		void Whitespace();
 		void Comment();
 		void Delimiter();
-		void KeywordOrIdentifier();
-		void Constant();
-
-		std::optional<double> LeftPart(std::string& buffer);
-		void RightPart(Complex& complex, std::string& buffer);
 
 		size_t Position() const;
 
 		const LexemesList& List() const;
-		std::vector<std::string>& Errors();
-		std::vector<LexemesList::Item>& Tokens();
+		std::pmr::vector<Diagnostic>& Errors();
+		std::pmr::vector<LexemesList::Item>& Tokens();
 		LexemesList& List();
-		void ThrowErr(std::string&& msg);
-		void AddErr(std::string&& msg);
+		void AddErr(Diagnostic::Kind kind, std::string_view payload = {});
+		// Text of an error payload: kept with the errors, or used in place by the error sink
+		std::string_view Payload(std::pmr::string& text);
+		void Emit(LexemesList::Item&& item);
+		// Token of an identifier or a constant, a new name gets the code after the count names of its class
+		LexemesList::Item Intern(TokenKind kind, size_t offset, std::string_view name, Code first_code, size_t& count);
 	};
 
-	std::ostream& operator<<(std::ostream& os, const Lexer::LexemesList& list);
-	std::ostream& operator<<(std::ostream& os, const Lexer::LexemesList::Item& item);
-	bool operator==(const Lexer::LexemesList::Item& lhs, const Lexer::LexemesList::Item& rhs);
-	bool operator==(const Lexer::LexemesList& lhs, const Lexer::LexemesList& rhs);
+	// Lexer over a Language policy (see Language.h). Instantiations are listed at the end of Lexer.cpp
+	template <class Language>
+	class BasicLexer : public LexerBase {
+	public:
+		using LexerBase::LexerBase;
+
+		void Parse();
+
+	private:
+		void Whitespace();
+		void KeywordOrIdentifier();
+		void Constant();
+
+		bool LeftPart(std::pmr::string& buffer, std::optional<uint64_t>& part);
+		bool RightPart(Complex& complex, std::pmr::string& buffer);
+	};
+
+	// Language is taken from the runtime Grammar
+	using Lexer = BasicLexer<DynamicLanguage>;
+	// Language is compiled into the lexer
+	using SignalLexer = BasicLexer<StaticLanguage<SignalLanguage>>;
+
+	std::ostream& operator<<(std::ostream& os, const LexerBase::LexemesList& list);
+	bool operator==(const LexerBase::LexemesList::Item& lhs, const Lexer::LexemesList::Item& rhs);
+	bool operator==(const LexerBase::LexemesList& lhs, const Lexer::LexemesList& rhs);
 }
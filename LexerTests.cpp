@@ -2,64 +2,66 @@
 #include <sstream>
 #include <fstream>
 #include "profile.h"
+#include "AsyncIO.h"
+#include <deque>
+#include "FixedCompiler.h"
+#include "Allocations.h"
+#include "Trace.h"
+#include "Prelude.h"
+#include <map>
+#include <mutex>
 
 using namespace Parse;
 using namespace std;
 
-shared_ptr<Grammar> CreateGrammar() {
-	auto grammar = make_shared<Grammar>();
-	grammar->symbols_attributes.fill(10);
-	for (size_t i = 0; i < grammar->symbols_attributes.size(); ++i) {
-		if ((i >= 'A' && i <= 'Z'))
-			grammar->symbols_attributes[i] = 2;
-		else if (i >= '0' && i <= '9')
-			grammar->symbols_attributes[i] = 1;
-		if (i >= 9 && i <= 13 || (i >= 'a' && i <= 'z'))
-			grammar->symbols_attributes[i] = 0;
-	}
-	grammar->symbols_attributes[40] = 4;
-	grammar->symbols_attributes[32] = 0;
-	grammar->symbols_attributes[36] = 5;
-	grammar->symbols_attributes[39] = 6;
-	grammar->symbols_attributes['='] = 3;
-	grammar->symbols_attributes[';'] = 3;
-	grammar->symbols_attributes['.'] = 3;
-	grammar->symbols_attributes[40] = 4;
-	grammar->key_words["PROGRAM"] = 401;
-	grammar->key_words["BEGIN"] = 402;
-	grammar->key_words["END"] = 403;
-	grammar->key_words["CONST"] = 404;
-	grammar->key_words["LOOP"] = 405;
-	grammar->key_words["ENDLOOP"] = 406;
-	grammar->key_words["RETURN"] = 407;
-	grammar->key_words["IN"] = 408;
-	return grammar;
-}
-
-void CompileProgram(istream& input, ostream& output) {
-	auto grammar = CreateGrammar();
-	Parse::Lexer lexer(grammar, input);
+shared_ptr<Grammar> CreateGrammar(pmr::memory_resource* memory) {
+	return MakeGrammar<SignalLanguage>(memory);
+}
+
+// The table parser stops at the first error, so only the recursive one takes the cap
+template <class SyntaxParser>
+static SyntaxParser MakeParser(shared_ptr<Grammar> grammar, const SignalLexer& lexer, const CompileOptions& options) {
+	if constexpr (is_same_v<SyntaxParser, Parse::Parser>)
+		return SyntaxParser(grammar, lexer.GetTokens(), lexer.GetLines(), options.max_errors);
+	else
+		return SyntaxParser(grammar, lexer.GetTokens(), lexer.GetLines());
+}
+
+template <class SyntaxParser>
+static bool Compile(istream& input, ostream& output, const CompileOptions& options) {
+	auto grammar = options.generator.prelude ? options.generator.prelude->MakeGrammar(options.memory)
+		: CreateGrammar(options.memory);
+	grammar->workers = options.workers;
+	Parse::SignalLexer lexer(grammar, input);
 	lexer.Parse();
+	Trace::CountInput(lexer.GetInputSize(), lexer.GetTokens().size());
 	const auto& errors = lexer.GetErrors();
 	if (errors.size()) {
+		// The parser still runs over the recognized tokens so that a single compile reports every problem
 		output << errors.size() << " lexer errors was found;\n";
 		for (const auto& error : errors)
 			output << error << endl;
+		auto parser = MakeParser<SyntaxParser>(grammar, lexer, options);
+		parser.Parse();
+		for (const auto& error : parser.GetErrors())
+			output << error << endl;
+		return false;
 	}
 	else {
 		// Lexer listing
 		//const auto& tokens = lexer.GetTokens();
 		//for (const auto& token : tokens) {
-		//	output << setw(10) << token.position.line << setw(10) << token.position.col << setw(10) << token.code << "\t";
+		//	auto position = lexer.GetLines().Resolve(token.offset);
+		//	output << setw(10) << position.line << setw(10) << position.col << setw(10) << token.code << "\t";
 		//	if (token.value.empty())
 		//		output << static_cast<char>(token.code) << endl;
 		//	else
 		//		output << token.value << endl;
 		//}
 
-		Parse::Parser parser(grammar, lexer.GetTokens());
+		auto parser = MakeParser<SyntaxParser>(grammar, lexer, options);
 		parser.Parse();
-		Parse::Generator generator(parser.GetTree());
+		Parse::Generator generator(grammar, parser.GetTree(), lexer.GetLines(), options.generator);
 		if (parser.GetErrors().empty()) {
 			generator.Generate();
 			//output << parser.RnderTree();
@@ -69,65 +71,528 @@ void CompileProgram(istream& input, ostream& output) {
 		for (const auto& error : generator.GetErrors())
 			output << error << endl;
 		if (generator.GetErrors().empty()) {
-			output << generator.GetListing();
+			generator.WriteListing(output);
 			output << endl << endl;
-			const auto& identifiers = generator.GetIdentifiers();
 			output << setw(30) << "IDENTIFIER" << setw(10) << "TYPE"
 				<< setw(10) << "OFFSET" << setw(10) << "SIZE" << endl;
-			for (const auto& identifier : generator.GetIdentifiersOrder()) {
-				output << setw(30) << identifiers.at(identifier).name << setw(10) << (identifiers.at(identifier).is_const ? "CONST" : "PROGRAM")
-					<< setw(10) << identifiers.at(identifier).offset << setw(10) << identifiers.at(identifier).size << endl;
+			for (const auto& identifier : generator.GetIdentifiers()) {
+				output << setw(30) << identifier.name << setw(10) << (identifier.is_const ? "CONST" : "PROGRAM")
+					<< setw(10) << identifier.offset << setw(10) << identifier.size << endl;
+			}
+			for (const auto& target : generator.GetInTargets())
+				output << setw(30) << target.name << setw(10) << "IN" << setw(10) << target.offset << setw(10) << target.size << endl;
+			if (options.generator.pool_constants) {
+				const auto& pooling = generator.GetPooling();
+				output << endl << "Constant pooling: " << pooling.folded << " constants folded, "
+					<< pooling.frame_bytes << " bytes of frame and " << pooling.instructions << " instructions saved" << endl;
+			}
+			if (options.generator.peephole) {
+				auto [before, after] = generator.GetInstructionsCount();
+				output << endl << "Peephole: " << before << " instructions before, " << after << " after" << endl;
 			}
 		}
+		return parser.GetErrors().empty() && generator.GetErrors().empty();
 	}
 }
 
-void StartTest(const string& path) {
-	ifstream input(path + "\\input.sig");
+// Every prelude is compiled once per process and lives until its end
+static const Prelude* LoadPrelude(const string& path) {
+	static mutex preludes_mutex;
+	static map<string, unique_ptr<Prelude>> preludes;
+	lock_guard<mutex> lock(preludes_mutex);
+	auto& prelude = preludes[path];
+	if (prelude) return prelude.get();
+	ifstream input(path);
+	if (!input.is_open()) throw runtime_error("Bad file path: " + path);
+	auto compiled = make_unique<Prelude>(input);
+	if (compiled->GetErrors().size()) {
+		ostringstream error;
+		error << "Prelude " << path << ": " << compiled->GetErrors().front();
+		throw runtime_error(error.str());
+	}
+	prelude = move(compiled);
+	return prelude.get();
+}
+
+bool ParseOption(const string& flag, CompileOptions& options) {
+	const string prelude = "--prelude=", max_errors = "--max-errors=";
+	if (flag == "-t") options.table_parser = true;
+	else if (flag.compare(0, max_errors.size(), max_errors) == 0) {
+		auto value = flag.substr(max_errors.size());
+		if (value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+		options.max_errors = stoul(value);
+	}
+	else if (flag.compare(0, prelude.size(), prelude) == 0) options.generator.prelude = LoadPrelude(flag.substr(prelude.size()));
+	else if (flag == "-p") options.generator.pool_constants = true;
+	else if (flag == "-O") options.generator.peephole = true;
+	else return false;
+	return true;
+}
+
+bool CompileProgram(istream& input, ostream& output, const CompileOptions& options) {
+	TRACE_SPAN("compile");
+	if (options.table_parser) return Compile<Parse::TableParser>(input, output, options);
+	return Compile<Parse::Parser>(input, output, options);
+}
+
+void StreamTokens(istream& input, ostream& output) {
+	auto grammar = CreateGrammar();
+	size_t errors = 0;
+	Parse::SignalLexer lexer(grammar, input, [&output, &lexer](const Lexer::LexemesList::Item& token) {
+		auto position = lexer.GetLines().Resolve(token.offset);
+		output << setw(10) << position.line << setw(10) << position.col << setw(10) << token.code << "\t";
+		if (token.value.empty())
+			output << static_cast<char>(token.code) << '\n';
+		else
+			output << token.value << '\n';
+	}, [&output, &errors](const Diagnostic& error) {
+		output << error << '\n';
+		errors++;
+	});
+	lexer.Parse();
+	if (errors) output << errors << " lexer errors was found;" << endl;
+}
+
+// The files are read and written whole, as by IoPool, so their I/O gets its own spans
+void StartTest(const string& path, const CompileOptions& options) {
+	Trace::File file(path);
+	stringstream program;
+	{
+		TRACE_SPAN("read");
+		ifstream input(path + "\\input.sig");
+		if (!input.is_open()) throw runtime_error("Bad file path: " + path);
+		program << input.rdbuf();
+	}
+	ostringstream listing;
+	CompileProgram(program, listing, options);
+	TRACE_SPAN("write");
 	ofstream output(path + "\\generated.txt");
-	if (input.is_open() && output.is_open()) CompileProgram(input, output);
-	else throw runtime_error("Bad file path: " + path);
-	input.close();
-	output.close();
+	if (!output.is_open()) throw runtime_error("Bad file path: " + path);
+	auto content = listing.str();
+	output.write(content.data(), content.size());
 }
 
 
-void CheckTests(const string& path) {
-	ifstream input(path);
-	if (input.is_open()) {
-		string test_path;
-		while (getline(input, test_path)) {
-			cout << "Test: '" + test_path + "': ";
-			ifstream expected(test_path + "\\expected.txt");
-			ifstream generated(test_path + "\\generated.txt");
-			size_t line = 1;
-			string exp_line, gen_line;
-			bool OK = true;
-			while (getline(expected, exp_line) && getline(generated, gen_line)) {
-				if (exp_line != gen_line) {
-					OK = false;
-					cerr << endl << "Line " << line << ": "<< gen_line << " != " << exp_line;
-				}
-				line++;
-			}
-			if (getline(expected, exp_line) || getline(expected, gen_line)) {
+// Line by line comparison, used only when the files differ
+bool CompareLines(string_view expected_text, string_view generated_text) {
+	istringstream expected{ string(expected_text) };
+	istringstream generated{ string(generated_text) };
+	size_t line = 1;
+	string exp_line, gen_line;
+	bool OK = true;
+	while (true) {
+		bool has_expected = static_cast<bool>(getline(expected, exp_line));
+		bool has_generated = static_cast<bool>(getline(generated, gen_line));
+		if (!has_expected || !has_generated) {
+			if (has_expected != has_generated) {
 				OK = false;
 				cerr << endl << "Unequal number of lines";
 			}
-			if (OK) cerr << "OK" << endl;		
+			return OK;
+		}
+		if (exp_line != gen_line) {
+			OK = false;
+			cerr << endl << "Line " << line << ": "<< gen_line << " != " << exp_line;
 		}
+		line++;
 	}
-	else throw runtime_error("Bad file path: " + path);
-	input.close();
 }
 
-void RunTests(const string& path) {
+vector<string> ReadTestsList(const string& path) {
 	ifstream input(path);
-	if (input.is_open()) {
-		string test_path;
-		while (getline(input, test_path))
-			StartTest(test_path);
+	if (!input.is_open()) throw runtime_error("Bad file path: " + path);
+	vector<string> tests;
+	string test_path;
+	while (getline(input, test_path))
+		tests.push_back(test_path);
+	return tests;
+}
+
+void CheckTests(const string& path) {
+	for (const auto& test_path : ReadTestsList(path)) {
+		cout << "Test: '" + test_path + "': ";
+		TRACE_SPAN("check", test_path);
+		MappedFile expected(test_path + "\\expected.txt");
+		MappedFile generated(test_path + "\\generated.txt");
+		bool OK = expected.Data() == generated.Data() || CompareLines(expected.Data(), generated.Data());
+		if (OK) cerr << "OK" << endl;
+	}
+}
+
+CompileOptions ReadOptions(const string& path) {
+	CompileOptions options;
+	ifstream flags(path);
+	for (string flag; flags >> flag;)
+		if (!ParseOption(flag, options)) throw runtime_error("Unknown option " + flag + " in " + path);
+	return options;
+}
+
+string CompileTest(const string& test_path, string program) {
+	Trace::File file(test_path);
+	istringstream input(move(program));
+	ostringstream listing;
+	CompileProgram(input, listing, ReadOptions(test_path + "\\options.txt"));
+	return listing.str();
+}
+
+void RunTests(const string& path) {
+	const size_t prefetch = 4;
+	auto tests = ReadTestsList(path);
+	IoPool io;
+	deque<future<optional<string>>> inputs;
+	vector<future<bool>> outputs;
+	size_t requested = 0;
+	for (const auto& test_path : tests) {
+		for (; requested < tests.size() && inputs.size() < prefetch; ++requested)
+			inputs.push_back(io.Read(tests[requested] + "\\input.sig"));
+		auto input = inputs.front().get();
+		inputs.pop_front();
+		if (!input) throw runtime_error("Bad file path: " + test_path);
+		outputs.push_back(io.Write(test_path + "\\generated.txt", CompileTest(test_path, move(*input))));
+	}
+	for (size_t i = 0; i < outputs.size(); ++i)
+		if (!outputs[i].get()) throw runtime_error("Bad file path: " + tests[i]);
+}
+
+// Buffers of a compile, sized by the length of the program
+struct FixedStorage {
+	explicit FixedStorage(size_t size)
+		: arena(Reader::default_window + 1024 * size + 4096), output(128 * size + 1024) {
+		buffers = { FixedBuffer(arena), FixedBuffer(output) };
+	}
+
+	vector<char> arena;
+	vector<char> output;
+	CompileBuffers buffers;
+};
+
+// Also returns the heap allocations made by the compile
+static FixedResult CompileCounted(string_view program, CompileBuffers& buffers, const CompileOptions& options,
+	size_t& allocations) {
+	Allocations::Start();
+	auto result = CompileFixed(program, buffers, options);
+	allocations = Allocations::Stop();
+	return result;
+}
+
+// A buffer that runs out stops the compile, still without allocating
+static void TestBufferFull() {
+	const string_view program = "PROGRAM P; BEGIN END.";
+	for (string_view buffer : { "arena", "output" }) {
+		FixedStorage storage(program.size());
+		(buffer == "arena" ? storage.buffers.arena : storage.buffers.output).capacity = 16;
+		size_t allocations;
+		auto result = CompileCounted(program, storage.buffers, {}, allocations);
+		ASSERT(!result.compiled);
+		ASSERT_EQUAL(allocations, 0u);
+		ASSERT(result.full.has_value());
+		ostringstream error;
+		error << *result.full;
+		ASSERT_EQUAL(error.str(), "Compiler: Error: The " + string(buffer) + " buffer is full;");
+	}
+}
+
+// Every test is compiled into the fixed buffers with the flags of its options.txt and with -t too: no allocation
+// is made, and the output is that of CompileProgram. The fixed compile goes first, so when this runs first in
+// the process nothing shared, as the parse table, is built by an earlier compile
+void TestAllocationFree(const string& path) {
+	TestRunner tr;
+	Trace::Prepare();
+	for (const auto& test_path : ReadTestsList(path)) {
+		tr.RunTest([&] {
+			MappedFile input(test_path + "\\input.sig");
+			auto program = input.Data();
+			for (bool table_parser : { false, true }) {
+				auto options = ReadOptions(test_path + "\\options.txt");
+				options.table_parser = options.table_parser || table_parser;
+				FixedStorage storage(program.size());
+				size_t allocations;
+				auto result = CompileCounted(program, storage.buffers, options, allocations);
+				ASSERT_EQUAL(allocations, 0u);
+				ASSERT(!result.full.has_value());
+
+				istringstream stream{ string(program) };
+				ostringstream expected;
+				bool compiled = CompileProgram(stream, expected, options);
+				ASSERT_EQUAL(result.compiled, compiled);
+				ASSERT_EQUAL(string(storage.output.data(), storage.buffers.output.size), expected.str());
+			}
+		}, "Allocation free: '" + test_path + "'");
+	}
+	RUN_TEST(tr, TestBufferFull);
+}
+
+// Program declaring the constants C0 = '0', C1 = '1', ... one per line
+static string Declarations(size_t count) {
+	string program = "PROGRAM P;\nCONST\n";
+	for (size_t i = 0; i < count; ++i)
+		program += "C" + to_string(i) + " = '" + to_string(i) + "';\n";
+	return program + "BEGIN\nEND.\n";
+}
+
+static bool Compiles(const string& program, const CompileOptions& options = {}) {
+	istringstream input(program);
+	ostringstream listing;
+	return CompileProgram(input, listing, options);
+}
+
+// Codes of constants start at 501 and of identifiers at 1001, from the 501st distinct constant on they meet
+static void TestManyConstants() {
+	auto program = Declarations(600);
+	CompileOptions table;
+	table.table_parser = true;
+	ASSERT(Compiles(program));
+	ASSERT(Compiles(program, table));
+}
+
+// The declarations list is a chain of nested nodes as long as the section, walking or releasing it must not recurse
+static void TestLongDeclarationsList() {
+	auto program = Declarations(300000);
+	CompileOptions table;
+	table.table_parser = true;
+	ASSERT(Compiles(program));
+	ASSERT(Compiles(program, table));
+}
+
+// Tree and errors of the parser with the given number of workers
+static string ParseWith(const string& program, size_t workers) {
+	auto grammar = CreateGrammar();
+	grammar->workers = workers;
+	istringstream input(program);
+	SignalLexer lexer(grammar, input);
+	lexer.Parse();
+	Parser parser(grammar, lexer.GetTokens(), lexer.GetLines());
+	parser.Parse();
+	ostringstream result;
+	result << parser.RnderTree();
+	for (const auto& error : parser.GetErrors())
+		result << error << '\n';
+	return result.str();
+}
+
+// A section long enough for four chunks is parsed by four workers and by one: the trees must be the same,
+// and so must the errors when the first one is in a later chunk
+static void TestParallelDeclarations() {
+	const size_t count = Parser::parallel_threshold / 5 * 2; // Five tokens per declaration
+	auto program = Declarations(count);
+	ASSERT_EQUAL(ParseWith(program, 4), ParseWith(program, 1));
+
+	auto broken = "C" + to_string(count * 3 / 4) + " = ";
+	program.replace(program.find(broken), broken.size(), broken + "= ");
+	auto errors = ParseWith(program, 1);
+	ASSERT(errors.find("Parser: Error") != string::npos);
+	ASSERT_EQUAL(ParseWith(program, 4), errors);
+}
+
+// Output of the compile with the given number of workers
+static string CompileWith(const string& program, size_t workers, bool pool_constants = false) {
+	CompileOptions options;
+	options.workers = workers;
+	options.generator.pool_constants = pool_constants;
+	istringstream input(program);
+	ostringstream output;
+	CompileProgram(input, output, options);
+	return output.str();
+}
+
+// A section long enough for the generator's chunks is emitted by four workers and by one: the listings must be
+// the same, also with pooled values shared across the chunks, and so must the first repeated name
+static void TestParallelGeneration() {
+	const size_t count = Generator::parallel_threshold * 2;
+	auto program = Declarations(count);
+	auto listing = CompileWith(program, 1);
+	ASSERT(listing.find("section .rodata") != string::npos);
+	ASSERT_EQUAL(CompileWith(program, 4), listing);
+
+	string pooled = "PROGRAM P;\nCONST\n";
+	for (size_t i = 0; i < count; ++i)
+		pooled += "C" + to_string(i) + " = '" + to_string(i % 1000) + "';\n";
+	pooled += "BEGIN\nEND.\n";
+	ASSERT_EQUAL(CompileWith(pooled, 4, true), CompileWith(pooled, 1, true));
+
+	auto repeated = "C" + to_string(count * 3 / 4) + " = ";
+	program.replace(program.find(repeated), repeated.size(), "C" + to_string(count / 4) + " = ");
+	auto errors = CompileWith(program, 1);
+	ASSERT(errors.find("is used a second time") != string::npos);
+	ASSERT_EQUAL(CompileWith(program, 4), errors);
+}
+
+void TestLargePrograms() {
+	TestRunner tr;
+	RUN_TEST(tr, TestManyConstants);
+	RUN_TEST(tr, TestLongDeclarationsList);
+	RUN_TEST(tr, TestParallelDeclarations);
+	RUN_TEST(tr, TestParallelGeneration);
+}
+
+static void WriteToken(ostream& output, const Lexer::LexemesList::Item& token, const LineIndex& lines) {
+	auto position = lines.Resolve(token.offset);
+	output << position.line << ':' << position.col << ' ' << static_cast<int>(token.kind) << ' ' << token.code
+		<< " '" << token.value << '\'';
+	if (token.complex)
+		for (const auto& part : { token.complex->left, token.complex->right, token.complex->exp })
+			output << ' ' << (part ? to_string(*part) : "-");
+	output << '\n';
+}
+
+// Tokens then errors of the program lexed through the window, whole or streamed
+static string Lex(const string& program, size_t window_size, bool stream) {
+	istringstream input(program);
+	ostringstream tokens, errors;
+	if (stream) {
+		unique_ptr<SignalLexer> lexer;
+		lexer = make_unique<SignalLexer>(CreateGrammar(), input, [&](const Lexer::LexemesList::Item& token) {
+			WriteToken(tokens, token, lexer->GetLines());
+		}, [&errors](const Diagnostic& error) { errors << error << '\n'; }, window_size);
+		lexer->Parse();
+	}
+	else {
+		SignalLexer lexer(CreateGrammar(), input, window_size);
+		lexer.Parse();
+		for (const auto& token : lexer.GetTokens())
+			WriteToken(tokens, token, lexer.GetLines());
+		for (const auto& error : lexer.GetErrors())
+			errors << error << '\n';
+	}
+	return tokens.str() + errors.str();
+}
+
+static void CheckWindows(const string& program, size_t max_window) {
+	auto expected = Lex(program, Reader::default_window, false);
+	for (size_t window = 1; window <= max_window; ++window) {
+		ASSERT_EQUAL(Lex(program, window, false), expected);
+		ASSERT_EQUAL(Lex(program, window, true), expected);
+	}
+}
+
+// Every window up to the length of the program puts a refill inside each of its tokens
+static void TestStraddlingTokens() {
+	CheckWindows("PROGRAM LONGPROGRAMNAME;\n(* a comment\n\tover two lines *)\nCONST\n"
+		"\tFIRST = '123 $EXP( 12 )';\n\tSECOND = '-45 67';\n\tTHIRD = '8 $EXPT(1)';\n"
+		"BEGIN\n\tLOOP IN FIRST; ENDLOOP;\n\t# ? RETURN;\nEND.\n(* unclosed", 200);
+}
+
+// A word that is not $EXP is looked for up to the next '(', which may be far past the constant:
+// only the start of the word inside the constant is kept for the error
+static void TestUnknownWordPayload() {
+	auto program = "PROGRAM P;\nCONST\n\tC = '5 X';\n" + string(1 << 20, 'A') + "\n(";
+	for (bool stream : { false, true }) {
+		auto errors = Lex(program, Reader::default_window, stream);
+		ASSERT(errors.find("unknown word X;") != string::npos);
+		errors = Lex("PROGRAM P;\nCONST\n\tC = '5 " + string(1000, 'X') + "(1)';", Reader::default_window, stream);
+		ASSERT(errors.find("unknown word " + string(LexerBase::word_limit, 'X') + ";") != string::npos);
+	}
+}
+
+// Bytes allocated from it at most at once
+class PeakMemory : public pmr::memory_resource {
+public:
+	size_t Peak() const { return peak; }
+
+private:
+	size_t used = 0;
+	size_t peak = 0;
+
+	void* do_allocate(size_t bytes, size_t alignment) override {
+		used += bytes;
+		peak = max(peak, used);
+		return pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* data, size_t bytes, size_t alignment) override {
+		used -= bytes;
+		pmr::new_delete_resource()->deallocate(data, bytes, alignment);
+	}
+	bool do_is_equal(const memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Streaming keeps the lines only from the start of the token being read: a long comment, many empty lines
+// or a long line of tabs take no more memory than a short program and a window of them
+static void TestStreamMemory() {
+	const size_t window = 4096;
+	auto peak = [&](const string& program) {
+		PeakMemory memory;
+		istringstream input(program);
+		SignalLexer lexer(CreateGrammar(&memory), input, [](const Lexer::LexemesList::Item&) {},
+			[](const Diagnostic&) {}, window);
+		lexer.Parse();
+		return memory.Peak();
+	};
+	auto base = peak("PROGRAM P;\nBEGIN END.\n");
+	string comment = "PROGRAM P;\n(*";
+	for (size_t i = 0; i < 100000; ++i)
+		comment += "\tcomment\n";
+	for (const auto& program : { comment + "*)\nBEGIN END.\n", "PROGRAM P;\n" + string(1000000, '\n') + "BEGIN END.\n",
+		"PROGRAM P;\n" + string(1000000, '\t') + "BEGIN END.\n" })
+		ASSERT(peak(program) < base + 2 * sizeof(size_t) * window); // A line start or a tab per byte of a window
+}
+
+void TestReaderWindows(const string& path) {
+	TestRunner tr;
+	RUN_TEST(tr, TestStraddlingTokens);
+	RUN_TEST(tr, TestUnknownWordPayload);
+	RUN_TEST(tr, TestStreamMemory);
+	for (const auto& test_path : ReadTestsList(path)) {
+		tr.RunTest([&] {
+			MappedFile input(test_path + "\\input.sig");
+			CheckWindows(string(input.Data()), 7);
+		}, "Reader windows: '" + test_path + "'");
+	}
+}
+
+// The listing without the parser's messages after the first one, the cap reached included
+static string FirstSyntaxError(const string& listing) {
+	istringstream lines(listing);
+	string result;
+	bool syntax_error = false;
+	for (string line; getline(lines, line);) {
+		bool is_syntax_error = line.rfind("Parser: ", 0) == 0;
+		if (is_syntax_error && syntax_error) continue;
+		syntax_error = syntax_error || is_syntax_error;
+		result += line + '\n';
+	}
+	return result;
+}
+
+void TestTableParser(const string& path) {
+	TestRunner tr;
+	for (const auto& test_path : ReadTestsList(path)) {
+		tr.RunTest([&] {
+			MappedFile input(test_path + "\\input.sig");
+			auto options = ReadOptions(test_path + "\\options.txt");
+			options.table_parser = false;
+			istringstream recursive_input{ string(input.Data()) }, table_input{ string(input.Data()) };
+			ostringstream recursive, table;
+			CompileProgram(recursive_input, recursive, options);
+			options.table_parser = true;
+			CompileProgram(table_input, table, options);
+			ASSERT_EQUAL(FirstSyntaxError(table.str()), FirstSyntaxError(recursive.str()));
+		}, "Table parser: '" + test_path + "'");
+	}
+}
+
+CompileCost MeasureCompile(string_view program) {
+	CompileCost cost{ chrono::nanoseconds::max(), CompileCost::fixed_budget + CompileCost::byte_budget * program.size() };
+	for (size_t attempt = 0; attempt < 3 && cost.IsOverBudget(); ++attempt) {
+		istringstream input{ string(program) };
+		ostringstream listing;
+		auto start = chrono::steady_clock::now();
+		cost.compiled = CompileProgram(input, listing);
+		cost.elapsed = min(cost.elapsed, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start));
+	}
+	return cost;
+}
+
+void ReplayCorpus(const string& path) {
+	size_t slow = 0;
+	cout << setw(40) << "INPUT" << setw(10) << "BYTES" << setw(10) << "US" << setw(10) << "NS/BYTE" << setw(10) << "ERRORS" << endl;
+	for (const auto& input_path : ReadTestsList(path)) {
+		MappedFile input(input_path);
+		if (!input.IsOpen()) throw runtime_error("Bad file path: " + input_path);
+		auto cost = MeasureCompile(input.Data());
+		slow += cost.IsOverBudget();
+		cout << setw(40) << input_path.substr(input_path.find_last_of('\\') + 1) << setw(10) << input.Data().size()
+			<< setw(10) << cost.elapsed.count() / 1000 << setw(10) << cost.elapsed.count() / max<size_t>(input.Data().size(), 1)
+			<< setw(10) << (cost.compiled ? "no" : "yes") << (cost.IsOverBudget() ? "  over the budget" : "") << endl;
 	}
-	else throw runtime_error("Bad file path: " + path);
-	input.close();
+	if (slow) throw runtime_error(to_string(slow) + " inputs of the corpus are over the budget");
 }
@@ -11,17 +11,67 @@
 #include <iomanip>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
 #include "Lexer.h"
 #include "Parser.h"
 #include "LexerTests.h"
 #include "test_runner.h"
 #include <unordered_set>
 #include "Generator.h"
+#include "TableParser.h"
 
-std::shared_ptr<Parse::Grammar> CreateGrammar();
+struct CompileOptions {
+	bool table_parser = false;         // -t
+	size_t max_errors = 20;            // --max-errors=<n>, syntax errors reported before the parser gives up
+	Parse::GeneratorOptions generator; // -p, -O, --prelude=<path>
+	// Everything of the compile is allocated from the memory, see Grammar
+	std::pmr::memory_resource* memory = std::pmr::get_default_resource();
+	size_t workers = 0;
+};
 
+// Applies a command line flag, false if the flag is unknown
+bool ParseOption(const std::string& flag, CompileOptions& options);
+// Flags of a test directory's options.txt (a test may keep its command line flags there), none if it is missing
+CompileOptions ReadOptions(const std::string& path);
+
+std::shared_ptr<Parse::Grammar> CreateGrammar(std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+std::vector<std::string> ReadTestsList(const std::string& path);
+// Listing of the program of the test directory, compiled with the flags of its options.txt
+std::string CompileTest(const std::string& test_path, std::string program);
 void RunTests(const std::string& path);
-void StartTest(const std::string& path);
+// Writes the listing or the errors of the program, true if it has no errors
+bool CompileProgram(std::istream& input, std::ostream& output, const CompileOptions& options = {});
+void StartTest(const std::string& path, const CompileOptions& options = {});
+void StreamTokens(std::istream& input, std::ostream& output);
 void CheckTests(const std::string& path);
+// Prints the differing lines to the standard error, true if the texts are equal line by line
+bool CompareLines(std::string_view expected_text, std::string_view generated_text);
+void TestAllocationFree(const std::string& path);
+// Programs too large for the tests directory, generated by the tests
+void TestLargePrograms();
+// Every test and a program with each kind of token are lexed through windows of a few bytes, so that tokens,
+// comments and constants straddle the refills: the tokens and the errors must not change
+void TestReaderWindows(const std::string& path);
+// Every test is compiled with -t as well: the listing must be the same, and so must the errors up to the first
+// syntax error, where the table parser stops
+void TestTableParser(const std::string& path);
+
+// Time of a compile against a budget linear in the size of the program
+struct CompileCost {
+	static constexpr std::chrono::nanoseconds fixed_budget = std::chrono::milliseconds(5);
+	static constexpr std::chrono::nanoseconds byte_budget = std::chrono::microseconds(2);
+
+	std::chrono::nanoseconds elapsed;
+	std::chrono::nanoseconds budget;
+	bool compiled = false; // Without errors, a seed of the clean path must stay so
+
+	bool IsOverBudget() const { return elapsed > budget; }
+};
+
+// The best of a few compiles if the first is over the budget, so a single hiccup is not reported
+CompileCost MeasureCompile(std::string_view program);
+// Compiles every file of the list of slow inputs found by the fuzzer (Fuzz.cpp), fails if any is over its budget
+void ReplayCorpus(const std::string& path);
 
 
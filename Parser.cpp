@@ -1,6 +1,10 @@
 #include "Parser.h"
 #include <sstream>
 #include <iomanip>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include "Trace.h"
 
 using namespace std;
 using namespace Parse;
@@ -10,150 +14,192 @@ void Parser::Scan() {
 		lexeme++;
 }
 
-LexemeIt Parser::GetLexeme() {
-	if (lexeme != lexemes_list.end()) return lexeme;
-	throw ParserError("Parser: Error: The end of the program was found earlier than expected;");
+Code Parser::Peek() const {
+	if (lexeme != lexemes_list.end()) return lexeme->code;
+	return 0; // No token has zero code
+}
+
+bool Parser::Peek(TokenKind kind) const {
+	return lexeme != lexemes_list.end() && lexeme->kind == kind;
+}
+
+bool Parser::Expect(Code code, string_view expected, const shared_ptr<Node>& node) {
+	if (Peek() != code) {
+		Report(expected);
+		return false;
+	}
+	node->children.emplace_back(NewNode(lexeme));
+	Scan();
+	return true;
+}
+
+void Parser::Report(string_view expected) {
+	panic = true;
+	if (lexeme == lexemes_list.end()) {
+		errors.push_back({ Diagnostic::Kind::UnexpectedEnd });
+		return;
+	}
+	errors.push_back({ Diagnostic::Kind::Expected, lines.Resolve(lexeme->offset), expected,
+		lexeme->value.size() ? lexeme->value : Diagnostic::Symbol(static_cast<char>(lexeme->code)) });
 }
 
 
-const std::vector<std::string>& Parser::GetErrors() const {
+const std::pmr::vector<Diagnostic>& Parser::GetErrors() const {
 	return errors;
 }
 
+// A list is a chain through the last children: the chain is released by the loop, every node with its last
+// child already detached, so the destructors of the other children recurse only as deep as they are.
+// Nothing is allocated, the tree is released even when its memory has run out
+Parser::Node::~Node() {
+	auto next = children.empty() ? nullptr : move(children.back());
+	while (next && next.use_count() == 1 && !next->children.empty()) {
+		auto tail = move(next->children.back());
+		next = move(tail);
+	}
+}
+
 string Parser::RnderTree() {
 	std::stringstream rendered_tree;
-	ComputeRender(rendered_tree, tree, 0);
+	ComputeRender(rendered_tree, tree);
 	return rendered_tree.str();
 }
 
-void Parser::ComputeRender(std::stringstream& render, std::shared_ptr<Node> node, size_t deep) {
-	render << setfill('.') << setw(deep * 2) << "";
-	render << node->not_term.value_or("");
-	if (node->term.has_value()) {
-		render << node->term.value()->code << " ";
-		if (node->term.value()->value.empty())
-			render << static_cast<char>(node->term.value()->code);
-		else
-			render << node->term.value()->value;
+void Parser::ComputeRender(std::stringstream& render, std::shared_ptr<Node> root) {
+	pmr::vector<pair<const Node*, size_t>> stack({ { root.get(), 0 } }, grammar->memory); // Node and its depth, in preorder
+	while (!stack.empty()) {
+		auto [node, deep] = stack.back();
+		stack.pop_back();
+		render << setfill('.') << setw(deep * 2) << "";
+		render << node->not_term.value_or("");
+		if (node->term.has_value()) {
+			render << node->term.value()->code << " ";
+			if (node->term.value()->value.empty())
+				render << static_cast<char>(node->term.value()->code);
+			else
+				render << node->term.value()->value;
+		}
+		render << '\n';
+		for (auto child = node->children.rbegin(); child != node->children.rend(); ++child)
+			stack.push_back({ child->get(), deep + 1 });
 	}
-	render << '\n';
-	for (auto& child : node->children)
-		ComputeRender(render, child, deep + 1);
 }
 
-void Parser::ThrowErr(string&& expected, LexemeIt found) {
-	throw ParserError("Parser: Error (line " + 
-		to_string(GetLexeme()->position.line) + ", column " + to_string(GetLexeme()->position.col) +
-		"): " + expected + " expected but " + (found->value.size() ? string(found->value) : (string() + static_cast<char>(found->code))) + " found;");
+void Parser::Parse() {
+	TRACE_SPAN("Parser::Parse");
+	tree->children.push_back(Program());
+	if (!panic && lexeme != lexemes_list.end()) Report("EOF");
 }
 
-void Parser::Parse() {
-	try {
-		tree->children.push_back(Program());
-		if (lexeme != lexemes_list.end()) ThrowErr("EOF", GetLexeme());
+void Parser::Synchronize(initializer_list<Code> stops) {
+	for (; lexeme != lexemes_list.end(); Scan())
+		for (auto stop : stops)
+			if (lexeme->code == stop) return;
+}
+
+bool Parser::Recover(initializer_list<Code> stops) {
+	if (aborted) return false;
+	if (errors.size() >= max_errors) {
+		errors.push_back({ Diagnostic::Kind::TooManyErrors });
+		aborted = true;
+		return false;
 	}
-	catch (ParserError& pr) {
-		errors.push_back(pr.what());
+	Synchronize(stops);
+	if (lexeme == lexemes_list.end()) { // Nothing left to resume on
+		aborted = true;
+		return false;
 	}
-	return;
+	panic = false;
+	return true;
 }
 
 shared_ptr<Parser::Node> Parser::Program() {
-	auto this_node = make_shared<Node>("<program>");
-	if (GetLexeme()->code != grammar->key_words["PROGRAM"]) ThrowErr("PROGRAM", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	auto this_node = NewNode("<program>");
+	if (!Expect(grammar->key_words.at("PROGRAM"), "PROGRAM", this_node)) return this_node;
 	this_node->children.push_back(ProcedureIdentifier());
-	if (GetLexeme()->code != ';') ThrowErr(";", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	if (panic || !Expect(';', ";", this_node)) return this_node;
 	this_node->children.push_back(Block());
-	if (GetLexeme()->code != '.') ThrowErr(".", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	if (!panic) Expect('.', ".", this_node);
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::ProcedureIdentifier() {
-	auto this_node = make_shared<Node>("<procedure-identifier>");
+	auto this_node = NewNode("<procedure-identifier>");
 	this_node->children.push_back(Identifier());
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::ConstantIdentifier() {
-	auto this_node = make_shared<Node>("<constant-identifier>");
+	auto this_node = NewNode("<constant-identifier>");
 	this_node->children.push_back(Identifier());
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Block() {
-	auto this_node = make_shared<Node>("<block>");
+	auto this_node = NewNode("<block>");
 	this_node->children.push_back(Declarations());
-	if (GetLexeme()->code != grammar->key_words["BEGIN"]) ThrowErr("BEGIN", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	if (!panic) Expect(grammar->key_words.at("BEGIN"), "BEGIN", this_node);
+	if (panic && Recover({ grammar->key_words.at("BEGIN"), grammar->key_words.at("END") })
+		&& Peek() == grammar->key_words.at("BEGIN"))
+		Expect(grammar->key_words.at("BEGIN"), "BEGIN", this_node);
+	if (panic) return this_node;
 	this_node->children.push_back(StatementsList());
-	if (GetLexeme()->code != grammar->key_words["END"]) ThrowErr("END", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	if (!panic) Expect(grammar->key_words.at("END"), "END", this_node);
+	if (panic && Recover({ grammar->key_words.at("END"), '.' })
+		&& Peek() == grammar->key_words.at("END"))
+		Expect(grammar->key_words.at("END"), "END", this_node);
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::StatementsList() {
-	auto this_node = make_shared<Node>("<statements-list>");
-	if ((GetLexeme()->code == grammar->key_words["LOOP"])
-		|| (GetLexeme()->code == grammar->key_words["IN"])
-		|| (GetLexeme()->code == grammar->key_words["RETURN"])) {
+	auto this_node = NewNode("<statements-list>");
+	if ((Peek() == grammar->key_words.at("LOOP"))
+		|| (Peek() == grammar->key_words.at("IN"))
+		|| (Peek() == grammar->key_words.at("RETURN"))) {
 		this_node->children.push_back(Statement());
-		this_node->children.push_back(StatementsList());
+		if (!panic) this_node->children.push_back(StatementsList());
 	} 
 	else this_node->children.push_back(Empty());
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Statement() {
-	auto this_node = make_shared<Node>("<statement>");
-	if (GetLexeme()->code == grammar->key_words["LOOP"]) {
-		this_node->children.emplace_back(make_shared<Node>(lexeme));
+	auto this_node = NewNode("<statement>");
+	StatementBody(this_node);
+	if (panic && Recover({ ';', grammar->key_words.at("ENDLOOP"), grammar->key_words.at("END") })
+		&& Peek() == ';')
 		Scan();
+	return this_node;
+}
+
+void Parser::StatementBody(shared_ptr<Node> this_node) {
+	if (Peek() == grammar->key_words.at("LOOP")) {
+		Expect(grammar->key_words.at("LOOP"), "LOOP", this_node);
 		this_node->children.push_back(StatementsList());
-		if (GetLexeme()->code != grammar->key_words["ENDLOOP"]) ThrowErr("ENDLOOP", GetLexeme());
-		else this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
-		if (GetLexeme()->code != ';') ThrowErr(";", GetLexeme());
-		else this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
+		if (!panic) Expect(grammar->key_words.at("ENDLOOP"), "ENDLOOP", this_node);
+		if (!panic) Expect(';', ";", this_node);
 	} 
-	else if (GetLexeme()->code == grammar->key_words["RETURN"]) {
-		this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
-		if (GetLexeme()->code != ';') ThrowErr(";", GetLexeme());
-		else this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
+	else if (Peek() == grammar->key_words.at("RETURN")) {
+		Expect(grammar->key_words.at("RETURN"), "RETURN", this_node);
+		Expect(';', ";", this_node);
 	}
-	else if (GetLexeme()->code == grammar->key_words["IN"]) {
-		this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
+	else if (Peek() == grammar->key_words.at("IN")) {
+		Expect(grammar->key_words.at("IN"), "IN", this_node);
 		this_node->children.push_back(Identifier());
-		if (GetLexeme()->code != ';') ThrowErr(";", GetLexeme());
-		else this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
+		if (!panic) Expect(';', ";", this_node);
 	}
-	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Declarations() {
-	auto this_node = make_shared<Node>("<declarations>");
+	auto this_node = NewNode("<declarations>");
 	this_node->children.push_back(ConstantDeclarations());
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::ConstantDeclarations() {
-	auto this_node = make_shared<Node>("<constant-declarations>");
-	if (GetLexeme()->code == grammar->key_words["CONST"]) {
-		this_node->children.emplace_back(make_shared<Node>(lexeme));
-		Scan();
-		if (GetLexeme()->code < 1001) ThrowErr("<constant-declarations-list>", GetLexeme());
+	auto this_node = NewNode("<constant-declarations>");
+	if (Peek() == grammar->key_words.at("CONST")) {
+		Expect(grammar->key_words.at("CONST"), "CONST", this_node);
 		this_node->children.push_back(ConstantDeclarationsList());
 	} 
 	else this_node->children.push_back(Empty());
@@ -161,45 +207,101 @@ shared_ptr<Parser::Node> Parser::ConstantDeclarations() {
 }
 
 shared_ptr<Parser::Node> Parser::ConstantDeclarationsList() {
-	auto this_node = make_shared<Node>("<constant-declarations-list>");
-	if (GetLexeme()->code >= 1001) {
-		this_node->children.push_back(ConstantDeclaration());
-		this_node->children.push_back(ConstantDeclarationsList());
+	pmr::vector<shared_ptr<Node>> declarations(grammar->memory);
+	ParallelDeclarations(declarations);
+	while (!panic && Peek(TokenKind::Identifier))
+		declarations.push_back(ConstantDeclaration());
+
+	// Nested the same way as the recursive rule, built from the tail so long sections do not recurse
+	shared_ptr<Node> tail;
+	if (!panic) {
+		tail = NewNode("<constant-declarations-list>");
+		tail->children.push_back(Empty());
+	}
+	for (auto it = declarations.rbegin(); it != declarations.rend(); ++it) {
+		auto this_node = NewNode("<constant-declarations-list>");
+		this_node->children.push_back(*it);
+		if (tail) this_node->children.push_back(tail);
+		tail = this_node;
+	}
+	return tail;
+}
+
+bool Parser::DeclarationsChunk(LexemeIt end, pmr::vector<shared_ptr<Node>>& declarations) {
+	while (lexeme < end && Peek(TokenKind::Identifier)) {
+		declarations.push_back(ConstantDeclaration());
+		if (aborted) return false;
+	}
+	return lexeme == end;
+}
+
+void Parser::ParallelDeclarations(pmr::vector<shared_ptr<Node>>& declarations) {
+	auto end = lexeme; // The section ends at the next key word
+	while (end != lexemes_list.end() && end->kind != TokenKind::KeyWord) ++end;
+	size_t size = end - lexeme;
+	size_t workers = grammar->workers ? grammar->workers : thread::hardware_concurrency();
+	size_t threads = min<size_t>(workers, size / (parallel_threshold / 4));
+	if (size < parallel_threshold || threads < 2) return;
+
+	// Chunk borders are moved past the nearest ';', so every chunk starts with a declaration
+	vector<LexemeIt> borders{ lexeme };
+	for (size_t i = 1; i < threads; ++i) {
+		auto border = max(borders.back(), lexeme + size * i / threads);
+		while (border != end && border->code != ';') ++border;
+		if (border != end) ++border;
+		borders.push_back(border);
+	}
+	borders.push_back(end);
+
+	vector<future<optional<pmr::vector<shared_ptr<Node>>>>> chunks;
+	for (size_t i = 0; i < threads; ++i)
+		chunks.push_back(async(launch::async, [this, begin = borders[i], end = borders[i + 1]]()
+			-> optional<pmr::vector<shared_ptr<Node>>> {
+			Parser worker(*this, begin);
+			pmr::vector<shared_ptr<Node>> result(grammar->memory);
+			if (!worker.DeclarationsChunk(end, result)) return {};
+			return result;
+		}));
+
+	// Chunks are taken in source order up to the first one with an error; the rest is parsed
+	// again sequentially, so the errors are the same as without the workers
+	bool failed = false;
+	for (size_t i = 0; i < threads; ++i) {
+		auto result = chunks[i].get();
+		failed = failed || !result;
+		if (failed) continue;
+		declarations.insert(declarations.end(), make_move_iterator(result->begin()), make_move_iterator(result->end()));
+		lexeme = borders[i + 1];
 	}
-	else this_node->children.push_back(Empty());;
-	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::ConstantDeclaration() {
-	auto this_node = make_shared<Node>("<constant-declaration>");
+	auto this_node = NewNode("<constant-declaration>");
 	this_node->children.push_back(ConstantIdentifier());
-	if (GetLexeme()->code != '=') ThrowErr("=", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
-	this_node->children.push_back(Constant());
-	if (GetLexeme()->code != ';') ThrowErr(";", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	if (!panic) Expect('=', "=", this_node);
+	if (!panic) this_node->children.push_back(Constant());
+	if (!panic) Expect(';', ";", this_node);
+	if (panic && Recover({ ';', grammar->key_words.at("BEGIN"), grammar->key_words.at("END") })
+		&& Peek() == ';')
+		Scan();
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Constant() {
-	auto this_node = make_shared<Node>("<constant>");
-	if(GetLexeme()->code < 501 || GetLexeme()->code > 1000) ThrowErr("<complex-constant>", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	auto this_node = NewNode("<constant>");
+	if (!Peek(TokenKind::Constant)) Report("<complex-constant>");
+	else Expect(Peek(), "<complex-constant>", this_node);
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Empty() {
-	auto this_node = make_shared<Node>("<empty>");
+	auto this_node = NewNode("<empty>");
 	return this_node;
 }
 
 shared_ptr<Parser::Node> Parser::Identifier() {
-	auto this_node = make_shared<Node>("<identifier>");
-	if (GetLexeme()->code < 1001) ThrowErr("<identifier>", GetLexeme());
-	else this_node->children.emplace_back(make_shared<Node>(lexeme));
-	Scan();
+	auto this_node = NewNode("<identifier>");
+	if (!Peek(TokenKind::Identifier)) Report("<identifier>");
+	else Expect(Peek(), "<identifier>", this_node);
 	return this_node;
-}
\ No newline at end of file
+}
@@ -2,48 +2,75 @@
 #include "Lexer.h"
 
 namespace Parse {
-	using LexemeIt = std::vector<Parse::Lexer::LexemesList::Item>::const_iterator;
-
-	class ParserError : public std::runtime_error {
-	public:
-		using std::runtime_error::runtime_error;
-	};
+	using LexemeIt = std::pmr::vector<Parse::Lexer::LexemesList::Item>::const_iterator;
 
 	class Parser {
 	public:
+		// The tree and the errors are allocated from the memory of the grammar
 		Parser(std::shared_ptr<Grammar> grammar, 
-			const std::vector<Parse::Lexer::LexemesList::Item>& lexemes)
-			: lexemes_list(lexemes), grammar(grammar), lexeme(lexemes_list.begin())
+			const std::pmr::vector<Parse::Lexer::LexemesList::Item>& lexemes, const LineIndex& lines, size_t max_errors = 20)
+			: tree(Node::Make(grammar->memory, "<signal_program>")), grammar(grammar), lexemes_list(lexemes), lines(lines),
+			lexeme(lexemes_list.begin()), errors(grammar->memory), max_errors(max_errors)
 		{};
 
+		// CONST sections of at least this many tokens are split into chunks parsed by the workers of the grammar
+		static constexpr size_t parallel_threshold = 1 << 14;
+
 		void Parse();
 		std::string RnderTree();
-		const std::vector<std::string>& GetErrors() const;
+		const std::pmr::vector<Diagnostic>& GetErrors() const;
 
 		auto GetTree() { return tree; }
 
 		struct Node {
-			Node(std::string not_term) : not_term(not_term) {};
-			Node(LexemeIt term) : term(term) {};
+			// Names of nonterminals are literals or names of the parse table
+			Node(std::string_view not_term, std::pmr::memory_resource* memory) : not_term(not_term), children(memory) {};
+			Node(LexemeIt term, std::pmr::memory_resource* memory) : term(term), children(memory) {};
+			~Node(); // Releases a list, which is as deep as it is long, without recursion
+
+			// Nodes allocated from the memory, as are their children
+			static std::shared_ptr<Node> Make(std::pmr::memory_resource* memory, std::string_view not_term) {
+				return std::allocate_shared<Node>(std::pmr::polymorphic_allocator<Node>(memory), not_term, memory);
+			}
+			static std::shared_ptr<Node> Make(std::pmr::memory_resource* memory, LexemeIt term) {
+				return std::allocate_shared<Node>(std::pmr::polymorphic_allocator<Node>(memory), term, memory);
+			}
 
-			std::optional<std::string> not_term;
+			std::optional<std::string_view> not_term;
 			std::optional<LexemeIt> term;
-			std::vector<std::shared_ptr<Node>> children;
+			std::pmr::vector<std::shared_ptr<Node>> children;
 		};
 
 	private:
-		std::shared_ptr<Node> tree = std::make_unique<Node>("<signal_program>");
+		std::shared_ptr<Node> tree;
 		std::shared_ptr<Grammar> grammar;
-		const std::vector<Parse::Lexer::LexemesList::Item>& lexemes_list;
+		const std::pmr::vector<Parse::Lexer::LexemesList::Item>& lexemes_list;
+		const LineIndex& lines;
 		LexemeIt lexeme;
 
-		std::vector<std::string> errors;
-		
-		void ComputeRender(std::stringstream&, std::shared_ptr<Node>, size_t deep = 0);
+		std::pmr::vector<Diagnostic> errors;
+		size_t max_errors;
+		bool panic = false;   // An error was found and the routines unwind up to the nearest recovery point
+		bool aborted = false; // Recovery is impossible: the error cap is reached or the program has ended
+
+		// Worker parsing a chunk of declarations: stops without recovery at the first error
+		Parser(const Parser& parent, LexemeIt from)
+			: tree(parent.tree), grammar(parent.grammar), lexemes_list(parent.lexemes_list), lines(parent.lines), lexeme(from),
+			errors(grammar->memory), max_errors(0)
+		{};
+
+		template <class Value>
+		std::shared_ptr<Node> NewNode(Value value) const { return Node::Make(grammar->memory, value); }
+
+		void ComputeRender(std::stringstream&, std::shared_ptr<Node>);
 
 		void Scan();
-		LexemeIt GetLexeme();
-		void ThrowErr(std::string&& expected, LexemeIt found);
+		Code Peek() const;
+		bool Peek(TokenKind kind) const;
+		bool Expect(Code code, std::string_view expected, const std::shared_ptr<Node>& node);
+		void Report(std::string_view expected);
+		void Synchronize(std::initializer_list<Code> stops);
+		bool Recover(std::initializer_list<Code> stops);
 
 		std::shared_ptr<Node> Program();
 		std::shared_ptr<Node> ProcedureIdentifier();
@@ -52,9 +79,12 @@ namespace Parse {
 		std::shared_ptr<Node> Declarations();
 		std::shared_ptr<Node> StatementsList();
 		std::shared_ptr<Node> Statement();
+		void StatementBody(std::shared_ptr<Node> this_node);
 		std::shared_ptr<Node> ConstantDeclarations();
 		std::shared_ptr<Node> ConstantDeclarationsList();
 		std::shared_ptr<Node> ConstantDeclaration();
+		void ParallelDeclarations(std::pmr::vector<std::shared_ptr<Node>>& declarations);
+		bool DeclarationsChunk(LexemeIt end, std::pmr::vector<std::shared_ptr<Node>>& declarations);
 		std::shared_ptr<Node> Constant();
 		std::shared_ptr<Node> Empty();
 		std::shared_ptr<Node> Identifier();
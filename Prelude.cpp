@@ -0,0 +1,25 @@
+#include "Prelude.h"
+
+using namespace std;
+using namespace Parse;
+
+Prelude::Prelude(istream& input) : grammar(Parse::MakeGrammar<SignalLanguage>()), lexer(grammar, input) {
+	lexer.Parse();
+	errors = lexer.GetErrors();
+	if (errors.size()) return;
+	parser = make_unique<Parser>(grammar, lexer.GetTokens(), lexer.GetLines());
+	parser->Parse();
+	errors = parser->GetErrors();
+	if (errors.size()) return;
+	generator = make_unique<Generator>(grammar, parser->GetTree(), lexer.GetLines());
+	generator->GeneratePrelude();
+	errors = generator->GetErrors();
+}
+
+shared_ptr<Grammar> Prelude::MakeGrammar(pmr::memory_resource* memory) const {
+	auto program = Parse::MakeGrammar<SignalLanguage>(memory);
+	program->symbols = SymbolTable(&grammar->symbols, memory);
+	program->identifiers_count = grammar->identifiers_count;
+	program->constants_count = grammar->constants_count;
+	return program;
+}
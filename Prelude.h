@@ -0,0 +1,25 @@
+#pragma once
+#include "Generator.h"
+
+namespace Parse {
+	// Constant declarations shared by many programs, compiled once and then frozen. The prelude is a program
+	// whose name and statements are not used. A program over the prelude interns its names on top of the
+	// prelude's symbols, starts with the prelude's constants declared at the bottom of the frame and with
+	// their code already generated, so only its own declarations are processed.
+	class Prelude {
+	public:
+		explicit Prelude(std::istream& input);
+
+		const std::pmr::vector<Diagnostic>& GetErrors() const { return errors; }
+		// Grammar of a program over the prelude, the program's own names are allocated from the memory
+		std::shared_ptr<Grammar> MakeGrammar(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) const;
+		const Generator& GetGenerator() const { return *generator; }
+
+	private:
+		std::shared_ptr<Grammar> grammar;
+		SignalLexer lexer;
+		std::unique_ptr<Parser> parser;       // The generator keeps views to the tokens and the tree
+		std::unique_ptr<Generator> generator;
+		std::pmr::vector<Diagnostic> errors;
+	};
+}
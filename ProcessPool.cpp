@@ -0,0 +1,185 @@
+#include "ProcessPool.h"
+#include "LexerTests.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+namespace {
+	constexpr size_t none = SIZE_MAX;
+
+	bool WriteAll(int fd, const void* data, size_t size) {
+		for (auto next = static_cast<const char*>(data); size;) {
+			auto written = write(fd, next, size);
+			if (written < 0 && errno == EINTR) continue;
+			if (written <= 0) return false;
+			next += written;
+			size -= static_cast<size_t>(written);
+		}
+		return true;
+	}
+
+	bool ReadAll(int fd, void* data, size_t size) {
+		for (auto next = static_cast<char*>(data); size;) {
+			auto read_size = read(fd, next, size);
+			if (read_size < 0 && errno == EINTR) continue;
+			if (read_size <= 0) return false;
+			next += read_size;
+			size -= static_cast<size_t>(read_size);
+		}
+		return true;
+	}
+
+	bool WriteMessage(int fd, string_view text) {
+		uint64_t size = text.size();
+		return WriteAll(fd, &size, sizeof(size)) && WriteAll(fd, text.data(), text.size());
+	}
+
+	bool ReadMessage(int fd, string& text) {
+		uint64_t size;
+		if (!ReadAll(fd, &size, sizeof(size))) return false;
+		text.resize(size);
+		return ReadAll(fd, text.data(), size);
+	}
+
+	enum class Status : char { Compiled, Failed };
+
+	// Worker: path of a test in, status and the listing or the reason of the failure out
+	[[noreturn]] void Work(int tasks, int results, size_t memory_limit) {
+		rlimit limit{ memory_limit, memory_limit };
+		setrlimit(RLIMIT_AS, &limit);
+		for (string test_path; ReadMessage(tasks, test_path);) {
+			auto status = Status::Compiled;
+			string listing;
+			try {
+				ifstream input(test_path + "\\input.sig");
+				if (!input.is_open()) throw runtime_error("Bad file path: " + test_path);
+				stringstream program;
+				program << input.rdbuf();
+				listing = CompileTest(test_path, program.str());
+			}
+			catch (exception& ex) {
+				status = Status::Failed;
+				listing = ex.what();
+			}
+			if (!WriteAll(results, &status, sizeof(status)) || !WriteMessage(results, listing)) break;
+		}
+		_exit(0); // The copy of the coordinator's state is not cleaned up
+	}
+
+	struct Worker {
+		pid_t pid = -1;
+		int tasks = -1;   // Write end
+		int results = -1; // Read end
+		size_t test = none;
+	};
+
+	Worker Spawn(const vector<Worker>& workers, size_t memory_limit) {
+		int tasks[2], results[2];
+		if (pipe(tasks) || pipe(results)) throw runtime_error("pipe failed: "s + strerror(errno));
+		Worker worker;
+		worker.pid = fork();
+		if (worker.pid < 0) throw runtime_error("fork failed: "s + strerror(errno));
+		if (!worker.pid) {
+			for (const auto& other : workers) { // Otherwise the other workers never see the end of their tasks
+				close(other.tasks);
+				close(other.results);
+			}
+			close(tasks[1]);
+			close(results[0]);
+			Work(tasks[0], results[1], memory_limit);
+		}
+		close(tasks[0]);
+		close(results[1]);
+		worker.tasks = tasks[1];
+		worker.results = results[0];
+		return worker;
+	}
+
+	string Reason(int status) {
+		if (WIFSIGNALED(status)) return "killed by signal "s + to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+		if (WIFEXITED(status)) return "exited with code " + to_string(WEXITSTATUS(status));
+		return "stopped";
+	}
+}
+
+void RunTestsIsolated(const string& path, size_t workers_count, size_t memory_limit) {
+	auto tests = ReadTestsList(path);
+	if (!workers_count) workers_count = max<size_t>(1, thread::hardware_concurrency());
+	workers_count = max<size_t>(1, min(workers_count, tests.size()));
+	signal(SIGPIPE, SIG_IGN); // A crashed worker is found by the end of its results
+
+	vector<string> listings(tests.size());
+	vector<string> failures(tests.size());
+	vector<Worker> workers;
+	size_t next = 0, done = 0;
+	auto assign = [&](Worker& worker) {
+		worker.test = next < tests.size() ? next++ : none;
+		if (worker.test != none) WriteMessage(worker.tasks, tests[worker.test]); // A failure shows as a crash
+	};
+	for (size_t i = 0; i < workers_count; ++i) {
+		workers.push_back(Spawn(workers, memory_limit));
+		assign(workers.back());
+	}
+
+	vector<pollfd> fds;
+	while (done < tests.size()) {
+		fds.clear();
+		for (const auto& worker : workers)
+			fds.push_back({ worker.results, static_cast<short>(worker.test != none ? POLLIN : 0), 0 });
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			throw runtime_error("poll failed: "s + strerror(errno));
+		}
+		for (size_t i = 0; i < workers.size(); ++i) {
+			auto& worker = workers[i];
+			if (worker.test == none || !fds[i].revents) continue;
+			Status status;
+			string listing;
+			if (ReadAll(worker.results, &status, sizeof(status)) && ReadMessage(worker.results, listing)) {
+				if (status == Status::Compiled) listings[worker.test] = move(listing);
+				else failures[worker.test] = "failed: " + listing;
+			}
+			else { // The worker died on this test
+				close(worker.tasks);
+				close(worker.results);
+				int exit_status = 0;
+				waitpid(worker.pid, &exit_status, 0);
+				failures[worker.test] = "crashed: the worker was " + Reason(exit_status);
+				worker = Worker{}; // Its pipes are closed, the replacement must not close them again
+				worker = Spawn(workers, memory_limit);
+			}
+			done++;
+			assign(worker);
+		}
+	}
+	for (auto& worker : workers) {
+		close(worker.tasks);
+		close(worker.results);
+		waitpid(worker.pid, nullptr, 0);
+	}
+
+	for (size_t i = 0; i < tests.size(); ++i) {
+		ofstream output(tests[i] + "\\generated.txt");
+		if (!output.is_open()) throw runtime_error("Bad file path: " + tests[i]);
+		if (failures[i].empty()) output << listings[i];
+		else {
+			output << "Compilation " << failures[i] << endl;
+			cerr << "Test: '" << tests[i] << "': compilation " << failures[i] << endl;
+		}
+	}
+}
+#else
+void RunTestsIsolated(const string& path, size_t, size_t) {
+	RunTests(path);
+}
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+// RunTests with every compile in one of the worker processes forked by the coordinator. A test whose
+// compile crashes the worker, throws or runs out of the memory limit is recorded as failed and its
+// generated.txt gets the reason; the worker is replaced and the run goes on. The outputs are written and
+// the failures listed in the order of tests.txt. Workers default to one per core. Without fork (Windows)
+// the tests are run in process.
+void RunTestsIsolated(const std::string& path, size_t workers = 0, size_t memory_limit = size_t(1) << 30);
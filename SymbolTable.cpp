@@ -0,0 +1,72 @@
+#include "SymbolTable.h"
+#include <cstring>
+
+using namespace std;
+using namespace Parse;
+
+size_t SymbolTable::Hash(string_view name) {
+	uint64_t hash = 14695981039346656037ull; // FNV-1a
+	for (unsigned char symbol : name) {
+		hash ^= symbol;
+		hash *= 1099511628211ull;
+	}
+	return static_cast<size_t>(hash);
+}
+
+size_t SymbolTable::Slot(string_view name, size_t hash) const {
+	size_t mask = slots.size() - 1;
+	size_t slot = hash & mask;
+	while (slots[slot] != none) {
+		const auto& symbol = symbols[slots[slot]];
+		if (symbol.hash == hash && symbol.name == name) break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+SymbolId SymbolTable::Find(string_view name) const {
+	if (base)
+		if (auto id = base->Find(name); id != none) return id;
+	if (slots.empty()) return none;
+	auto id = slots[Slot(name, Hash(name))];
+	return id == none ? none : static_cast<SymbolId>(base_size + id);
+}
+
+pair<SymbolId, bool> SymbolTable::Intern(string_view name, Code code) {
+	if (base)
+		if (auto id = base->Find(name); id != none) return { id, false };
+	if ((symbols.size() + 1) * 2 > slots.size()) Rehash(); // Load factor stays below one half
+	size_t hash = Hash(name);
+	size_t slot = Slot(name, hash);
+	if (slots[slot] != none) return { static_cast<SymbolId>(base_size + slots[slot]), false };
+	SymbolId id = static_cast<SymbolId>(symbols.size());
+	symbols.push_back({ Store(name), code, hash });
+	slots[slot] = id;
+	return { static_cast<SymbolId>(base_size + id), true };
+}
+
+string_view SymbolTable::Store(string_view name) {
+	if (name.size() > chunk_size) {
+		chunks.emplace_back(name.begin(), name.end());
+		chunk_used = chunk_size; // The next name starts a new chunk
+		return { chunks.back().data(), name.size() };
+	}
+	if (chunk_used + name.size() > chunk_size) {
+		chunks.emplace_back(chunk_size);
+		chunk_used = 0;
+	}
+	char* place = chunks.back().data() + chunk_used;
+	memcpy(place, name.data(), name.size());
+	chunk_used += name.size();
+	return { place, name.size() };
+}
+
+void SymbolTable::Rehash() {
+	slots.assign(slots.empty() ? 64 : slots.size() * 2, none);
+	size_t mask = slots.size() - 1;
+	for (SymbolId id = 0; id < symbols.size(); ++id) {
+		size_t slot = symbols[id].hash & mask;
+		while (slots[slot] != none) slot = (slot + 1) & mask;
+		slots[slot] = id;
+	}
+}
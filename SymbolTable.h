@@ -0,0 +1,55 @@
+#pragma once
+#include <string_view>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+#include <utility>
+
+namespace Parse {
+	using Code = size_t;
+	using SymbolId = uint32_t;
+
+	// Interned identifiers and constants with dense ids. Open addressing with linear probing over
+	// an array of ids; names are kept in chunks, so views returned by Name() live as long as the table.
+	// A table may extend a frozen base table: the names of the base keep their ids and the new ones follow.
+	// Everything is allocated from the given memory.
+	class SymbolTable {
+	public:
+		static constexpr SymbolId none = UINT32_MAX;
+
+		explicit SymbolTable(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+			: symbols(memory), slots(memory), chunks(memory) {}
+		// The base must outlive the table and is not changed anymore
+		SymbolTable(const SymbolTable* base, std::pmr::memory_resource* memory)
+			: base(base), base_size(base ? base->Size() : 0), symbols(memory), slots(memory), chunks(memory) {}
+
+		// Returns the id of the name and whether it was added; a new name gets the given code
+		std::pair<SymbolId, bool> Intern(std::string_view name, Code code);
+		SymbolId Find(std::string_view name) const;
+
+		std::string_view Name(SymbolId id) const { return id < base_size ? base->Name(id) : symbols[id - base_size].name; }
+		Code GetCode(SymbolId id) const { return id < base_size ? base->GetCode(id) : symbols[id - base_size].code; }
+		size_t Size() const { return base_size + symbols.size(); }
+
+	private:
+		struct Symbol {
+			std::string_view name;
+			Code code;
+			size_t hash;
+		};
+
+		static constexpr size_t chunk_size = 4096;
+
+		const SymbolTable* base = nullptr;
+		size_t base_size = 0;
+		std::pmr::vector<Symbol> symbols;
+		std::pmr::vector<SymbolId> slots;
+		std::pmr::vector<std::pmr::vector<char>> chunks;
+		size_t chunk_used = chunk_size;
+
+		static size_t Hash(std::string_view name);
+		size_t Slot(std::string_view name, size_t hash) const;
+		std::string_view Store(std::string_view name);
+		void Rehash();
+	};
+}
@@ -0,0 +1,227 @@
+#include "TableParser.h"
+#include <stdexcept>
+#include <unordered_map>
+#include "Trace.h"
+
+using namespace std;
+using namespace Parse;
+
+static vector<string_view> Split(string_view body) {
+	vector<string_view> symbols;
+	while (!body.empty()) {
+		auto space = body.find(' ');
+		if (space) symbols.push_back(body.substr(0, space));
+		if (space == string_view::npos) break;
+		body.remove_prefix(space + 1);
+	}
+	return symbols;
+}
+
+static bool IsNonterminal(string_view symbol) {
+	return symbol.size() > 2 && symbol.front() == '<' && symbol.back() == '>';
+}
+
+ParseTable::Symbol ParseTable::AddTerminal(string_view symbol, const Grammar& grammar) {
+	if (symbol == "identifier") return identifier;
+	if (symbol == "constant") return constant;
+	Code code;
+	if (symbol.size() == 1) code = static_cast<unsigned char>(symbol.front());
+	else if (grammar.key_words.count(pmr::string(symbol))) code = grammar.key_words.at(pmr::string(symbol));
+	else throw logic_error("Parse table: unknown terminal " + string(symbol));
+	if (code >= terminal_of_code.size()) terminal_of_code.resize(code + 1, none);
+	if (terminal_of_code[code] == none) {
+		terminal_of_code[code] = names.size();
+		names.emplace_back(symbol);
+	}
+	return terminal_of_code[code];
+}
+
+ParseTable::ParseTable(vector<Production> productions, const Grammar& grammar) {
+	identifier = 0;
+	names.emplace_back("<identifier>");
+	constant = 1;
+	names.emplace_back("<complex-constant>");
+	end = 2;
+	names.emplace_back("EOF");
+	for (const auto& production : productions)
+		for (auto symbol : Split(production.body))
+			if (!IsNonterminal(symbol)) AddTerminal(symbol, grammar);
+	terminals = names.size();
+
+	unordered_map<string_view, Symbol> nonterminal_of;
+	for (const auto& production : productions)
+		if (nonterminal_of.try_emplace(production.head, names.size()).second)
+			names.emplace_back(production.head);
+	for (const auto& production : productions) {
+		Rule rule{ nonterminal_of.at(production.head) };
+		for (auto symbol : Split(production.body)) {
+			if (!IsNonterminal(symbol)) rule.body.push_back(AddTerminal(symbol, grammar));
+			else if (nonterminal_of.count(symbol)) rule.body.push_back(nonterminal_of.at(symbol));
+			else throw logic_error("Parse table: no productions for " + string(symbol));
+		}
+		rules.push_back(move(rule));
+	}
+	Build();
+}
+
+const ParseTable& ParseTable::Signal(const Grammar& grammar) {
+	static const ParseTable table(signal_rules, grammar);
+	return table;
+}
+
+// Built before main, so that no compile allocates it: the first -t compile into fixed buffers must not either
+[[maybe_unused]] static const ParseTable& signal_table = ParseTable::Signal(*MakeGrammar<SignalLanguage>());
+
+void ParseTable::ComputeFirst() {
+	size_t count = names.size() - terminals;
+	first.assign(count, vector<bool>(terminals));
+	nullable.assign(count, false);
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (const auto& rule : rules) {
+			size_t head = rule.head - terminals;
+			bool body_nullable = true;
+			for (auto symbol : rule.body) {
+				if (IsTerminal(symbol)) {
+					if (!first[head][symbol]) first[head][symbol] = changed = true;
+					body_nullable = false;
+					break;
+				}
+				for (size_t terminal = 0; terminal < terminals; ++terminal)
+					if (first[symbol - terminals][terminal] && !first[head][terminal])
+						first[head][terminal] = changed = true;
+				if (!nullable[symbol - terminals]) {
+					body_nullable = false;
+					break;
+				}
+			}
+			if (body_nullable && !nullable[head]) nullable[head] = changed = true;
+		}
+	}
+}
+
+void ParseTable::Build() {
+	ComputeFirst();
+	size_t count = names.size() - terminals;
+	vector<vector<bool>> follow(count, vector<bool>(terminals));
+	follow[0][end] = true;
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (const auto& rule : rules) {
+			// Walk the body from the end, keeping what may follow the current symbol
+			vector<bool> trailer = follow[rule.head - terminals];
+			for (auto it = rule.body.rbegin(); it != rule.body.rend(); ++it) {
+				if (IsTerminal(*it)) {
+					trailer.assign(terminals, false);
+					trailer[*it] = true;
+					continue;
+				}
+				auto& symbol_follow = follow[*it - terminals];
+				for (size_t terminal = 0; terminal < terminals; ++terminal)
+					if (trailer[terminal] && !symbol_follow[terminal])
+						symbol_follow[terminal] = changed = true;
+				if (!nullable[*it - terminals]) trailer.assign(terminals, false);
+				for (size_t terminal = 0; terminal < terminals; ++terminal)
+					if (first[*it - terminals][terminal]) trailer[terminal] = true;
+			}
+		}
+	}
+
+	table.assign(count * terminals, none);
+	default_rule.assign(count, none);
+	vector<size_t> productions(count);
+	for (const auto& rule : rules)
+		productions[rule.head - terminals]++;
+	for (size_t index = 0; index < rules.size(); ++index) {
+		const auto& rule = rules[index];
+		size_t head = rule.head - terminals;
+		vector<bool> lookahead(terminals);
+		bool body_nullable = true;
+		for (auto symbol : rule.body) {
+			if (IsTerminal(symbol)) {
+				lookahead[symbol] = true;
+				body_nullable = false;
+				break;
+			}
+			for (size_t terminal = 0; terminal < terminals; ++terminal)
+				if (first[symbol - terminals][terminal]) lookahead[terminal] = true;
+			if (!nullable[symbol - terminals]) {
+				body_nullable = false;
+				break;
+			}
+		}
+		if (productions[head] == 1) default_rule[head] = index;
+		if (body_nullable) {
+			if (default_rule[head] == none) default_rule[head] = index;
+			for (size_t terminal = 0; terminal < terminals; ++terminal)
+				if (follow[head][terminal]) lookahead[terminal] = true;
+		}
+		for (size_t terminal = 0; terminal < terminals; ++terminal) {
+			if (!lookahead[terminal]) continue;
+			auto& cell = table[head * terminals + terminal];
+			if (cell != none && cell != index)
+				throw logic_error("Parse table: grammar is not LL(1) at " + names[rule.head] + " on " + names[terminal]);
+			cell = index;
+		}
+	}
+}
+
+ParseTable::Symbol ParseTable::Terminal(LexemeIt lexeme, LexemeIt last) const {
+	if (lexeme == last) return end;
+	return Terminal(*lexeme);
+}
+
+ParseTable::Symbol ParseTable::Terminal(const Lexer::LexemesList::Item& lexeme) const {
+	if (lexeme.kind == TokenKind::Identifier) return identifier;
+	if (lexeme.kind == TokenKind::Constant) return constant;
+	if (lexeme.code < terminal_of_code.size()) return terminal_of_code[lexeme.code];
+	return none;
+}
+
+size_t ParseTable::RuleFor(Symbol nonterminal, Symbol terminal) const {
+	size_t head = nonterminal - terminals;
+	if (terminal != none && table[head * terminals + terminal] != none)
+		return table[head * terminals + terminal];
+	return default_rule[head]; // The error is then reported by the first terminal that does not match
+}
+
+void TableParser::Report(string_view expected, LexemeIt found) {
+	if (found == lexemes_list.end()) {
+		errors.push_back({ Diagnostic::Kind::UnexpectedEnd });
+		return;
+	}
+	errors.push_back({ Diagnostic::Kind::Expected, lines.Resolve(found->offset), expected,
+		found->value.size() ? found->value : Diagnostic::Symbol(static_cast<char>(found->code)) });
+}
+
+void TableParser::Parse() {
+	TRACE_SPAN("TableParser::Parse");
+	struct Entry {
+		ParseTable::Symbol symbol;
+		Parser::Node* parent;
+	};
+	pmr::vector<Entry> stack({ { table.Start(), nullptr } }, memory);
+	auto lexeme = lexemes_list.begin();
+	while (!stack.empty()) {
+		auto [symbol, parent] = stack.back();
+		stack.pop_back();
+		auto terminal = table.Terminal(lexeme, lexemes_list.end());
+		if (table.IsTerminal(symbol)) {
+			if (symbol != terminal) return Report(table.Name(symbol), lexeme);
+			parent->children.push_back(Parser::Node::Make(memory, lexeme));
+			++lexeme;
+			continue;
+		}
+		auto rule = table.RuleFor(symbol, terminal);
+		if (rule == ParseTable::none) return Report(table.Name(symbol), lexeme);
+		auto node = tree.get(); // The start symbol is the root of the tree
+		if (parent) {
+			parent->children.push_back(Parser::Node::Make(memory, table.Name(symbol)));
+			node = parent->children.back().get();
+		}
+		const auto& body = table.GetRule(rule).body;
+		for (auto it = body.rbegin(); it != body.rend(); ++it)
+			stack.push_back({ *it, node });
+	}
+	if (lexeme != lexemes_list.end()) Report("EOF", lexeme);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "Parser.h"
+#include <array>
+
+namespace Parse {
+	// Production of the grammar, the body is a space separated list of symbols:
+	// <name> - nonterminal, identifier and constant - tokens of those classes, anything else - key word or delimiter
+	struct Production {
+		std::string_view head;
+		std::string_view body;
+	};
+
+	// Syntax rules of README.md, the lexical rules are covered by the lexer
+	constexpr std::array<Production, 19> signal_rules{ {
+		{ "<signal-program>", "<program>" },
+		{ "<program>", "PROGRAM <procedure-identifier> ; <block> ." },
+		{ "<block>", "<declarations> BEGIN <statements-list> END" },
+		{ "<statements-list>", "<statement> <statements-list>" },
+		{ "<statements-list>", "<empty>" },
+		{ "<statement>", "LOOP <statements-list> ENDLOOP ;" },
+		{ "<statement>", "RETURN ;" },
+		{ "<statement>", "IN <identifier> ;" },
+		{ "<declarations>", "<constant-declarations>" },
+		{ "<constant-declarations>", "CONST <constant-declarations-list>" },
+		{ "<constant-declarations>", "<empty>" },
+		{ "<constant-declarations-list>", "<constant-declaration> <constant-declarations-list>" },
+		{ "<constant-declarations-list>", "<empty>" },
+		{ "<constant-declaration>", "<constant-identifier> = <constant> ;" },
+		{ "<constant>", "constant" },
+		{ "<constant-identifier>", "<identifier>" },
+		{ "<procedure-identifier>", "<identifier>" },
+		{ "<identifier>", "identifier" },
+		{ "<empty>", "" },
+	} };
+
+	// LL(1) table computed from the productions, the first production defines the start symbol
+	class ParseTable {
+	public:
+		template <size_t N>
+		ParseTable(const std::array<Production, N>& rules, const Grammar& grammar)
+			: ParseTable(std::vector<Production>(rules.begin(), rules.end()), grammar) {}
+		ParseTable(std::vector<Production> rules, const Grammar& grammar);
+		// Table of signal_rules, built once per process before main: it depends only on the key word codes,
+		// which are the same in every grammar of the language
+		static const ParseTable& Signal(const Grammar& grammar);
+
+		using Symbol = size_t;
+		static constexpr size_t none = SIZE_MAX;
+
+		struct Rule {
+			Symbol head;
+			std::vector<Symbol> body;
+		};
+
+		Symbol Start() const { return terminals; }
+		bool IsTerminal(Symbol symbol) const { return symbol < terminals; }
+		Symbol Terminal(LexemeIt lexeme, LexemeIt end) const;
+		Symbol Terminal(const Lexer::LexemesList::Item& lexeme) const;
+		Symbol End() const { return end; }
+		size_t RuleFor(Symbol nonterminal, Symbol terminal) const;
+		const Rule& GetRule(size_t rule) const { return rules[rule]; }
+		const std::string& Name(Symbol symbol) const { return names[symbol]; }
+
+	private:
+		// Terminals go first (key words and delimiters, identifier, constant, end of the program),
+		// then nonterminals starting with the start symbol
+		size_t terminals = 0;
+		Symbol identifier = none;
+		Symbol constant = none;
+		Symbol end = none;
+		std::vector<Symbol> terminal_of_code; // Key words and delimiters by code
+		std::vector<std::string> names;
+		std::vector<Rule> rules;
+		std::vector<size_t> table;           // [nonterminal][terminal] -> rule
+		std::vector<size_t> default_rule;    // Used on a missing entry: the nullable or the only production
+		std::vector<std::vector<bool>> first;   // [nonterminal][terminal]
+		std::vector<bool> nullable;
+
+		Symbol AddTerminal(std::string_view symbol, const Grammar& grammar);
+		void ComputeFirst();
+		void Build();
+	};
+
+	// Parser driven by the ParseTable with an explicit stack; builds the same tree as Parser
+	// and stops at the first error
+	class TableParser {
+	public:
+		// The tree, the stack and the errors are allocated from the memory of the grammar
+		TableParser(std::shared_ptr<Grammar> grammar,
+			const std::pmr::vector<Parse::Lexer::LexemesList::Item>& lexemes, const LineIndex& lines)
+			: table(ParseTable::Signal(*grammar)), memory(grammar->memory), tree(Parser::Node::Make(memory, "<signal_program>")),
+			lexemes_list(lexemes), lines(lines), errors(memory) {};
+
+		void Parse();
+		const std::pmr::vector<Diagnostic>& GetErrors() const { return errors; }
+
+		auto GetTree() { return tree; }
+
+	private:
+		const ParseTable& table;
+		std::pmr::memory_resource* memory;
+		std::shared_ptr<Parser::Node> tree;
+		const std::pmr::vector<Parse::Lexer::LexemesList::Item>& lexemes_list;
+		const LineIndex& lines;
+		std::pmr::vector<Diagnostic> errors;
+
+		void Report(std::string_view expected, LexemeIt found);
+	};
+}
@@ -0,0 +1,207 @@
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace Trace {
+	atomic<bool> enabled = false;
+
+	namespace {
+		struct Event {
+			const char* name;
+			array<char, 96> file; // The end of the name, zero terminated
+			int64_t start;        // ns since Enable
+			int64_t duration;
+		};
+
+		// Written only by its thread; a slot is published by the release of the count
+		struct Ring {
+			static constexpr size_t capacity = 1 << 13;
+
+			size_t thread = 0;
+			Ring* next = nullptr;
+			atomic<size_t> written = 0;
+			array<Event, capacity> events;
+		};
+
+		// The rings outlive their threads, so the spans of finished workers are still dumped
+		atomic<Ring*> rings = nullptr;
+		atomic<size_t> threads = 0;
+		chrono::steady_clock::time_point origin;
+
+		thread_local Ring* ring = nullptr;
+		thread_local string_view current_file;
+
+		struct Totals {
+			const char* name;
+			size_t calls = 0;
+			int64_t duration = 0;
+			PerfCounters::Values counters{};
+		};
+
+		atomic<bool> tracing = false;
+		atomic<bool> counting = false;
+		constexpr size_t prepared_phases = 64;
+		mutex totals_mutex;
+		vector<Totals> totals; // In the order the phases were first left
+		bool counters_checked = false;
+		string counters_error; // Of the first thread, empty if it opened any counter
+		atomic<size_t> input_bytes = 0;
+		atomic<size_t> input_tokens = 0;
+
+		// Opened by the first span of the thread, the error of the first thread is reported
+		PerfCounters& ThreadCounters() {
+			thread_local unique_ptr<PerfCounters> counters;
+			if (counters) return *counters;
+			counters = make_unique<PerfCounters>();
+			lock_guard<mutex> lock(totals_mutex);
+			if (!counters_checked) counters_error = counters->Error();
+			counters_checked = true;
+			return *counters;
+		}
+
+		Ring& ThreadRing() {
+			if (ring) return *ring;
+			ring = new Ring;
+			ring->thread = ++threads;
+			ring->next = rings.load();
+			while (!rings.compare_exchange_weak(ring->next, ring));
+			return *ring;
+		}
+
+		int64_t Now() {
+			return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+		}
+
+		void Escape(ostream& os, string_view text) {
+			for (char symbol : text) {
+				if (symbol == '"' || symbol == '\\') os << '\\' << symbol;
+				else if (static_cast<unsigned char>(symbol) < ' ') os << ' ';
+				else os << symbol;
+			}
+		}
+	}
+
+	void Enable() {
+		origin = chrono::steady_clock::now();
+		tracing = true;
+		enabled = true;
+	}
+
+	void EnableCounters() {
+		counting = true;
+		enabled = true;
+	}
+
+	void Prepare() {
+		if (tracing) ThreadRing();
+		if (!counting) return;
+		ThreadCounters();
+		lock_guard<mutex> lock(totals_mutex);
+		totals.reserve(prepared_phases);
+	}
+
+	void CountInput(size_t bytes, size_t tokens) {
+		if (!counting) return;
+		input_bytes += bytes;
+		input_tokens += tokens;
+	}
+
+	File::File(string_view name) : previous(current_file) {
+		current_file = name;
+	}
+
+	File::~File() {
+		current_file = previous;
+	}
+
+	void Span::Begin(const char* span_name, string_view span_file) {
+		name = span_name;
+		file = span_file.empty() ? current_file : span_file;
+		if (counting) counters = ThreadCounters().Read();
+		start = Now();
+	}
+
+	void Span::End() {
+		int64_t end = Now();
+		if (counting) {
+			auto now = ThreadCounters().Read();
+			lock_guard<mutex> lock(totals_mutex);
+			auto phase = find_if(totals.begin(), totals.end(), [this](const Totals& phase) { return phase.name == name; });
+			if (phase == totals.end()) phase = totals.insert(totals.end(), { name });
+			phase->calls++;
+			phase->duration += end - start;
+			for (size_t i = 0; i < PerfCounters::Count; ++i)
+				phase->counters[i] += now[i] - counters[i];
+		}
+		if (!tracing) return;
+		auto& events = ThreadRing();
+		size_t index = events.written.load(memory_order_relaxed);
+		auto& event = events.events[index % Ring::capacity];
+		event.name = name;
+		auto tail = file.substr(file.size() - min(file.size(), event.file.size() - 1));
+		memcpy(event.file.data(), tail.data(), tail.size());
+		event.file[tail.size()] = '\0';
+		event.start = start;
+		event.duration = end - start;
+		events.written.store(index + 1, memory_order_release);
+	}
+
+	void Dump(ostream& os) {
+		os << "{\"traceEvents\":[";
+		bool first = true;
+		for (Ring* events = rings.load(); events; events = events->next) {
+			size_t written = events->written.load(memory_order_acquire);
+			for (size_t i = written - min(written, Ring::capacity); i < written; ++i) {
+				const auto& event = events->events[i % Ring::capacity];
+				os << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"compile\",\"ph\":\"X\""
+					<< fixed << setprecision(3) << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0
+					<< ",\"pid\":1,\"tid\":" << events->thread << ",\"args\":{\"file\":\"";
+				Escape(os, event.file.data());
+				os << "\"}}";
+				first = false;
+			}
+		}
+		os << "\n]}\n";
+	}
+
+	static void Table(ostream& os, string_view title, size_t divisor, const PerfCounters& counters) {
+		os << endl << title << endl << setw(30) << "PHASE" << setw(10) << "CALLS" << setw(10) << "MS";
+		for (size_t i = 0; i < PerfCounters::Count; ++i)
+			os << setw(10) << PerfCounters::Name(static_cast<PerfCounters::Counter>(i));
+		os << endl;
+		for (const auto& phase : totals) {
+			os << setw(30) << phase.name << setw(10) << phase.calls << setw(10) << phase.duration / 1e6;
+			for (size_t i = 0; i < PerfCounters::Count; ++i) {
+				if (counters.IsAvailable(static_cast<PerfCounters::Counter>(i)))
+					os << setw(10) << static_cast<double>(phase.counters[i]) / max<size_t>(divisor, 1);
+				else
+					os << setw(10) << "-";
+			}
+			os << endl;
+		}
+	}
+
+	void Report(ostream& os) {
+		lock_guard<mutex> lock(totals_mutex);
+		os << fixed << setprecision(3) << "Phase counters over " << input_bytes << " bytes and " << input_tokens << " tokens";
+		if (!counters_error.empty()) { // Only the time is known
+			os << ", hardware counters are unavailable (" << counters_error << ")" << endl
+				<< setw(30) << "PHASE" << setw(10) << "CALLS" << setw(10) << "MS" << endl;
+			for (const auto& phase : totals)
+				os << setw(30) << phase.name << setw(10) << phase.calls << setw(10) << phase.duration / 1e6 << endl;
+			return;
+		}
+		PerfCounters counters; // Only tells which counters the threads could open
+		os << endl;
+		Table(os, "Per input byte", input_bytes, counters);
+		Table(os, "Per token", input_tokens, counters);
+	}
+}
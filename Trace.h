@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include "Counters.h"
+
+// Timeline of the compile phases in the Chrome trace_event format, viewable in chrome://tracing
+// or ui.perfetto.dev. Each thread records its spans into its own ring buffer without locking,
+// the oldest spans are overwritten when it is full. The spans can also sum the hardware counters
+// per phase name. While both are off a span costs one relaxed load.
+namespace Trace {
+	extern std::atomic<bool> enabled; // Spans are measured
+
+	void Enable();
+	void EnableCounters();
+	// Writes the spans of every thread; the traced threads must be done with their work
+	void Dump(std::ostream& os);
+
+	// Allocates what the spans of this thread use while they are measured: its ring, its counters and room
+	// for the totals of a few dozen phases. After it the spans of the thread allocate nothing
+	void Prepare();
+
+	// Input the counters are normalized by
+	void CountInput(size_t bytes, size_t tokens);
+	// Time and counters of every phase per input byte and per token
+	void Report(std::ostream& os);
+
+	// File the spans of this thread are tagged with while it is alive
+	class File {
+	public:
+		explicit File(std::string_view name);
+		~File();
+		File(const File&) = delete;
+		File& operator=(const File&) = delete;
+
+	private:
+		std::string_view previous;
+	};
+
+	class Span {
+	public:
+		// The name must be a literal, the file is the current one if none is given
+		explicit Span(const char* name, std::string_view file = {}) {
+			if (enabled.load(std::memory_order_relaxed)) Begin(name, file);
+		}
+		~Span() {
+			if (name) End();
+		}
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+
+	private:
+		const char* name = nullptr;
+		std::string_view file;
+		int64_t start = 0;
+		PerfCounters::Values counters;
+
+		void Begin(const char* span_name, std::string_view span_file);
+		void End();
+	};
+}
+
+#define TRACE_ID_IMPL(lineno) _trace_span_##lineno
+#define TRACE_ID(lineno) TRACE_ID_IMPL(lineno)
+
+#define TRACE_SPAN(...) \
+    Trace::Span TRACE_ID(__LINE__){__VA_ARGS__};
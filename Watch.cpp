@@ -0,0 +1,140 @@
+#include "Watch.h"
+#include "LexerTests.h"
+#include "AsyncIO.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cstring>
+#include <set>
+#include <unordered_map>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+namespace {
+	constexpr int quiet_ms = 10; // Events closer than this are one change
+	constexpr uint32_t test_events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR;
+	constexpr uint32_t root_events = IN_CREATE | IN_MOVED_TO | IN_ONLYDIR;
+
+	bool IsTestFile(string_view name) {
+		return name == "input.sig" || name == "options.txt" || name == "expected.txt";
+	}
+
+	class Watcher {
+	public:
+		explicit Watcher(const string& directory) : root(directory) {
+			fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (fd < 0) throw runtime_error("inotify_init1 failed: "s + strerror(errno));
+			root_wd = inotify_add_watch(fd, root.c_str(), root_events);
+			if (root_wd < 0) throw runtime_error("Bad directory path: " + root);
+			unique_ptr<DIR, int(*)(DIR*)> dir(opendir(root.c_str()), closedir);
+			if (!dir) throw runtime_error("Bad directory path: " + root);
+			while (auto entry = readdir(dir.get()))
+				if (entry->d_name[0] != '.') Add(entry->d_name);
+		}
+		~Watcher() { close(fd); }
+
+		void Run() {
+			cerr << "Watching " << tests.size() << " test directories in " << root << endl;
+			set<string> changed; // Ordered, so a batch is checked in the order of the names
+			alignas(inotify_event) char events[64 * 1024];
+			while (true) {
+				pollfd ready{ fd, POLLIN, 0 };
+				int count = poll(&ready, 1, changed.empty() ? -1 : quiet_ms);
+				if (count < 0) {
+					if (errno == EINTR) continue;
+					throw runtime_error("poll failed: "s + strerror(errno));
+				}
+				if (!count) { // Quiet: the batch is complete
+					for (const auto& test : changed)
+						Check(test);
+					changed.clear();
+					continue;
+				}
+				for (ssize_t size; (size = read(fd, events, sizeof(events))) > 0;)
+					for (auto next = events; next < events + size;) {
+						auto event = reinterpret_cast<const inotify_event*>(next);
+						next += sizeof(inotify_event) + event->len;
+						Dispatch(*event, changed);
+					}
+			}
+		}
+
+	private:
+		string root;
+		int fd = -1;
+		int root_wd = -1;
+		unordered_map<int, string> tests; // Watch -> test directory
+
+		// False if the name is not a directory
+		bool Add(const string& name) {
+			auto test = root + "/" + name;
+			int wd = inotify_add_watch(fd, test.c_str(), test_events);
+			if (wd < 0) return false;
+			tests[wd] = move(test);
+			return true;
+		}
+
+		void Dispatch(const inotify_event& event, set<string>& changed) {
+			if (event.mask & IN_Q_OVERFLOW) { // Events were lost, any test may have changed
+				for (const auto& [wd, test] : tests)
+					changed.insert(test);
+				return;
+			}
+			if (event.wd == root_wd) {
+				// The files of a new test may have been written before its watch
+				if (event.mask & IN_ISDIR && Add(event.name)) changed.insert(root + "/" + event.name);
+				return;
+			}
+			auto test = tests.find(event.wd);
+			if (test == tests.end()) return;
+			if (event.mask & IN_IGNORED) tests.erase(test); // The directory was removed
+			else if (event.len && IsTestFile(event.name)) changed.insert(test->second);
+		}
+
+		void Check(const string& test) {
+			auto start = chrono::steady_clock::now();
+			cout << "Test: '" + test + "': " << flush;
+			try {
+				MappedFile input(test + "/input.sig");
+				if (!input.IsOpen()) {
+					cerr << "no input.sig" << endl;
+					return;
+				}
+				istringstream program{ string(input.Data()) };
+				ostringstream listing;
+				CompileProgram(program, listing, ReadOptions(test + "/options.txt"));
+				auto generated = listing.str();
+				ofstream output(test + "/generated.txt");
+				if (!output.is_open()) throw runtime_error("Bad file path: " + test);
+				output << generated;
+				output.close();
+				MappedFile expected(test + "/expected.txt");
+				if (!expected.IsOpen()) {
+					cerr << "no expected.txt" << endl;
+					return;
+				}
+				bool OK = expected.Data() == generated || CompareLines(expected.Data(), generated);
+				auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+				if (OK) cerr << "OK (" << elapsed.count() << " us)";
+				cerr << endl;
+			}
+			catch (exception& ex) {
+				cerr << ex.what() << endl;
+			}
+		}
+	};
+}
+
+void WatchTests(const string& directory) {
+	Watcher(directory).Run();
+}
+#else
+void WatchTests(const string&) {
+	throw runtime_error("Watch mode needs inotify (Linux)");
+}
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+#include <string>
+
+// Watches the test directories under the directory (inotify) and checks a test again whenever its
+// input.sig, options.txt or expected.txt is written: the program is compiled, generated.txt rewritten and
+// compared with expected.txt. Events are collected until the directory is quiet for a few milliseconds, so an
+// editor's save compiles once. A new test directory is picked up when it appears. Runs until interrupted;
+// Linux only.
+void WatchTests(const std::string& directory);
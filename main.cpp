@@ -1,4 +1,7 @@
 ﻿#include "LexerTests.h"
+#include "Trace.h"
+#include "ProcessPool.h"
+#include "Watch.h"
 
 using namespace std;
 
@@ -7,12 +10,42 @@ int main(int argc, const char* argv[]) {
 	//StartTest("..\\Debug\\tests\\test_max");
 	//return 1;
 	try {
-		if (argc > 1) {
-			if (string(argv[1]) == "-d") {
+		int arg = 1;
+		bool trace = false, counters = false;
+		for (; arg + 1 < argc; ++arg) {
+			if (string(argv[arg]) == "-T") trace = true;
+			else if (string(argv[arg]) == "-P") counters = true;
+			else break;
+		}
+		if (trace) Trace::Enable();
+		if (counters) Trace::EnableCounters();
+		if (argc > arg) {
+			if (string(argv[arg]) == "-d") {
+				TestAllocationFree("..\\Debug\\tests\\tests.txt"); // First, before any compile
 				RunTests("..\\Debug\\tests\\tests.txt");
 				CheckTests("..\\Debug\\tests\\tests.txt");
+				TestLargePrograms();
+				TestReaderWindows("..\\Debug\\tests\\tests.txt");
+				TestTableParser("..\\Debug\\tests\\tests.txt");
+			}
+			else if (string(argv[arg]) == "-m") {
+				RunTestsIsolated("..\\Debug\\tests\\tests.txt");
+				CheckTests("..\\Debug\\tests\\tests.txt");
+			}
+			else if (string(argv[arg]) == "-b") ReplayCorpus("..\\Debug\\tests\\corpus\\corpus.txt");
+			else if (string(argv[arg]) == "-s") StreamTokens(cin, cout);
+			else if (string(argv[arg]) == "--watch" && arg + 1 < argc) WatchTests(argv[arg + 1]);
+			else {
+				CompileOptions options;
+				while (arg + 1 < argc && ParseOption(argv[arg], options))
+					++arg;
+				StartTest(argv[arg], options);
+			}
+			if (trace) {
+				ofstream trace_file("trace.json");
+				Trace::Dump(trace_file);
 			}
-			else StartTest(argv[1]);
+			if (counters) Trace::Report(cerr);
 			return 0;
 		}
 	}